@@ -0,0 +1,384 @@
+/* ******************************************************************
+   Microbenchmarks for the simulator and protocol hot paths.
+
+   The simulator is compiled into this file (with its main() renamed)
+   so the benchmarks can drive its event list directly. Each bench_*
+   binary links one protocol, e.g. bench_sr = this file + sr.o.
+   Timings are wall clock; fixed seeds keep the work identical between
+   runs so that the numbers can be compared across builds.
+ **********************************************************************/
+
+#include <unistd.h>
+
+#define main simulator_main
+#include "../src/simulator.c"
+#undef main
+
+#include "../include/proto.h"
+#include "../include/scan.h"
+#include "../include/wire.h"
+
+double bench_now();
+
+#define BENCH_SEED 1234
+#define BENCH_MINTIME 0.2     /* seconds each measurement runs for at least */
+
+volatile int bench_sink;
+
+/* the simulation every benchmark works on */
+struct sim_state *bench_sim;
+
+void bench_report(const char *name, long ops, double secs)
+{
+	printf("%-36s %12.1f ns/op %14.0f ops/s\n", name, secs * 1e9 / ops, ops / secs);
+}
+
+/* resets the simulator and protocol so a measurement starts from a fresh state */
+void bench_reset(int window)
+{
+	struct sim_state *sim = bench_sim;
+
+	clear_events(sim);
+	sim->TRACE = 0;
+	sim->lossprob = 0.0;
+	sim->corruptprob = 0.0;
+	sim->lambda = 10.0;
+	sim->win_size = window;
+	set_time(sim, 0);
+	sim->nsim = 0;
+	sim->cur_msg_sent = sim->cur_msg_recv = 0;
+	sim_srand(sim, BENCH_SEED);
+	sim->protocol->A_init(sim);
+	sim->protocol->B_init(sim);
+}
+
+void bench_insertevent(int depth)
+{
+	struct sim_state *sim = bench_sim;
+	char name[64];
+	struct event *evptr;
+	long ops = 0;
+	int i;
+	double start, secs;
+
+	/* a steady list of depth events: each round inserts one at a random
+	   future time and takes the earliest off, advancing the clock to it */
+	bench_reset(1);
+	for (i = 0; i < depth; i++){
+		evptr = (struct event *)malloc(sizeof(struct event));
+		evptr->evtime = TICKS(1000.0 * jimsrand(sim));
+		evptr->evtype = TIMER_INTERRUPT;
+		evptr->eventity = B;
+		insertevent(sim, evptr);
+	}
+	start = bench_now();
+	do {
+		for (i = 0; i < 1000; i++){
+			evptr = (struct event *)malloc(sizeof(struct event));
+			evptr->evtime = sim->sim_ticks + TICKS(1000.0 * jimsrand(sim));
+			evptr->evtype = TIMER_INTERRUPT;
+			evptr->eventity = B;
+			insertevent(sim, evptr);
+			evptr = sim->evlist;
+			sim->evlist = sim->evlist->next;
+			sim->evlist->prev = NULL;
+			set_time(sim, evptr->evtime);
+			free(evptr);
+		}
+		ops += 1000;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "insertevent (depth %d)", depth);
+	bench_report(name, ops, secs);
+}
+
+void bench_tolayer3(int inflight)
+{
+	struct sim_state *sim = bench_sim;
+	char name[64];
+	struct pkt packet;
+	long ops = 0;
+	int i;
+	double start, secs;
+
+	bench_reset(1);
+	memset(&packet, 'a', sizeof(packet));
+	start = bench_now();
+	do {
+		for (i = 0; i < inflight; i++){
+			tolayer3(sim, A, packet);
+		}
+		clear_events(sim);
+		ops += inflight;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "tolayer3 (%d in flight)", inflight);
+	bench_report(name, ops, secs);
+}
+
+void bench_checksum()
+{
+	struct pkt packet;
+	long ops = 0;
+	int i;
+	double start, secs;
+
+	memset(&packet, 'q', sizeof(packet));
+	start = bench_now();
+	do {
+		for (i = 0; i < 100000; i++){
+			packet.seqnum = i;
+			packet.checksum = compute_checksum(packet.seqnum, packet.acknum, packet.payload);
+			bench_sink += validate_checksum(packet);
+		}
+		ops += 100000;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	bench_report("compute+validate_checksum", ops, secs);
+}
+
+/* encode + decode of a data packet and its ACK in the compact wire format */
+void bench_wire()
+{
+	struct wire_ctx tx[2], rx[2];
+	struct pkt packet, ack, out;
+	uint8_t buf[WIRE_MAXLEN];
+	long ops = 0;
+	int i, len;
+	double start, secs;
+
+	for (i = 0; i < 2; i++){
+		wire_init(&tx[i]);
+		wire_init(&rx[i]);
+	}
+	memset(&packet, 'q', sizeof(packet));
+	memset(&ack, 0, sizeof(ack));
+	packet.acknum = ack.seqnum = 1;
+	start = bench_now();
+	do {
+		for (i = 0; i < 100000; i++){
+			packet.seqnum = ack.acknum = i;
+			packet.checksum = compute_checksum(packet.seqnum, packet.acknum, packet.payload);
+			ack.checksum = compute_checksum(ack.seqnum, ack.acknum, ack.payload);
+			len = wire_encode(&tx[0], &packet, 0, buf);
+			bench_sink += wire_decode(&rx[0], buf, len, &out);
+			len = wire_encode(&tx[1], &ack, WIRE_ACK, buf);
+			bench_sink += wire_decode(&rx[1], buf, len, &out);
+		}
+		ops += 100000;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	bench_report("wire encode+decode, data+ACK", ops, secs);
+}
+
+/* takes the next timer event off the list and hands it to A, as main() would */
+int bench_fire_timer()
+{
+	struct sim_state *sim = bench_sim;
+	struct event *q;
+	for (q = sim->evlist; q != NULL; q = q->next)
+		if (q->evtype == TIMER_INTERRUPT && q->eventity == A)
+			break;
+	if (q == NULL)
+		return 0;
+	if (q->prev != NULL)
+		q->prev->next = q->next;
+	else
+		sim->evlist = q->next;
+	if (q->next != NULL)
+		q->next->prev = q->prev;
+	set_time(sim, q->evtime);
+	free(q);
+	sim->protocol->A_timerinterrupt(sim);
+	return 1;
+}
+
+/* cost of a timeout with a full window outstanding: the window scans of gbn/sr */
+void bench_window_timeout(int window)
+{
+	struct sim_state *sim = bench_sim;
+	char name[64];
+	struct msg message;
+	long ops = 0;
+	int i;
+	double start, secs;
+
+	bench_reset(window);
+	sim->lossprob = 1.0;   /* nothing arrives, so the window stays full */
+	memset(message.data, 'w', sizeof(message.data));
+	for (i = 0; i < window; i++){
+		sim->protocol->A_output(sim, message);
+	}
+	start = bench_now();
+	do {
+		for (i = 0; i < 100; i++){
+			if (!bench_fire_timer())
+				break;
+		}
+		ops += i;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME && i == 100);
+	sprintf(name, "timeout, full window (w=%d)", window);
+	if (ops > 0)
+		bench_report(name, ops, secs);
+}
+
+/* cost of a selective ACK inside a full window with a packet unACKed every */
+/* spacing packets; sr rescans the window for its oldest unACKed packet     */
+void bench_window_ack(int window, int spacing)
+{
+	struct sim_state *sim = bench_sim;
+	char name[64];
+	struct msg message;
+	struct pkt ack;
+	int i, nholes = window / spacing - 1, nacks = nholes < 512 ? nholes : 512;
+	double start, secs;
+
+	bench_reset(window);
+	sim->lossprob = 1.0;   /* nothing arrives, so the window stays full */
+	memset(message.data, 'w', sizeof(message.data));
+	for (i = 0; i < window; i++){
+		sim->protocol->A_output(sim, message);
+	}
+	memset(&ack, 0, sizeof(ack));
+	ack.seqnum = 1;
+	for (i = 1; i < window; i++){
+		if (i % spacing != 0){
+			ack.acknum = i;
+			ack.checksum = compute_checksum(ack.seqnum, ack.acknum, ack.payload);
+			sim->protocol->A_input(sim, ack);
+		}
+	}
+	/* filling holes spread over the window, leaving the base unACKed */
+	start = bench_now();
+	for (i = 0; i < nacks; i++){
+		ack.acknum = spacing * (1 + (int)((long)i * nholes / nacks));
+		ack.checksum = compute_checksum(ack.seqnum, ack.acknum, ack.payload);
+		sim->protocol->A_input(sim, ack);
+	}
+	secs = bench_now() - start;
+	sprintf(name, "selective ACK, 1/%d unACKed (w=%d)", spacing, window);
+	bench_report(name, nacks, secs);
+}
+
+/* the window scan kernels of sr against their scalar versions, over a window    */
+/* with every other packet ACKed; "expired" finds nothing and so scans it all,    */
+/* "all expired" finds half of the window, "next unACKed" runs over a fully ACKed */
+/* window                                                                         */
+double bench_scan_time[PROTO_RING];
+uint64_t bench_scan_acked[RING_WORDS];
+uint64_t bench_scan_expired[RING_WORDS];
+
+void bench_scan(int window, int simd)
+{
+	char name[64];
+	long ops = 0;
+	int i, from = PROTO_RING - window / 2, to = from + window;
+	double start, secs;
+
+	for (i = 0; i < PROTO_RING; i++){
+		bench_scan_time[i] = (double)((i * 7919) % 1000);
+	}
+	memset(bench_scan_acked, 0x55, sizeof(bench_scan_acked));
+	start = bench_now();
+	do {
+		for (i = 0; i < 100; i++){
+			bench_sink += simd ? (int)scan_oldest(bench_scan_time, bench_scan_acked, from, to, 1e9)
+				: (int)scan_oldest_scalar(bench_scan_time, bench_scan_acked, from, to, 1e9);
+		}
+		ops += 100;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "scan oldest, %s (w=%d)", simd ? SCAN_ISA : "scalar", window);
+	bench_report(name, ops, secs);
+
+	ops = 0;
+	start = bench_now();
+	do {
+		for (i = 0; i < 100; i++){
+			bench_sink += simd ? scan_first_expired(bench_scan_time, bench_scan_acked, from, to, 1000, 1000, 0.01)
+				: scan_first_expired_scalar(bench_scan_time, bench_scan_acked, from, to, 1000, 1000, 0.01);
+		}
+		ops += 100;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "scan expired, %s (w=%d)", simd ? SCAN_ISA : "scalar", window);
+	bench_report(name, ops, secs);
+
+	ops = 0;
+	start = bench_now();
+	do {
+		for (i = 0; i < 100; i++){
+			bench_sink += simd ? scan_expired(bench_scan_time, bench_scan_acked, from, to, 1500, 1000, 0.01, bench_scan_expired)
+				: scan_expired_scalar(bench_scan_time, bench_scan_acked, from, to, 1500, 1000, 0.01, bench_scan_expired);
+		}
+		ops += 100;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "scan all expired, %s (w=%d)", simd ? SCAN_ISA : "scalar", window);
+	bench_report(name, ops, secs);
+
+	memset(bench_scan_acked, 0xff, sizeof(bench_scan_acked));
+	ops = 0;
+	start = bench_now();
+	do {
+		for (i = 0; i < 100; i++){
+			bench_sink += simd ? scan_next_unacked(bench_scan_acked, from, to)
+				: scan_next_unacked_scalar(bench_scan_acked, from, to);
+		}
+		ops += 100;
+	} while ((secs = bench_now() - start) < BENCH_MINTIME);
+	sprintf(name, "scan next unACKed, %s (w=%d)", simd ? SCAN_ISA : "scalar", window);
+	bench_report(name, ops, secs);
+}
+
+/* events per second of a whole simulation; must run last as sim_main() does not reset its state */
+void bench_simulation()
+{
+	struct sim_state *sim = bench_sim;
+	char *argv[] = {"bench", "-s", "1234", "-w", "10", "-m", "900", "-l", "0.1",
+		"-c", "0.1", "-t", "50", "-v", "0", NULL};
+	double start, secs;
+	int saved_stdout;
+	FILE *devnull;
+
+	bench_reset(10);
+	sim->A_application = sim->A_transport = sim->B_application = sim->B_transport = 0;
+	fflush(stdout);
+	saved_stdout = dup(1);
+	devnull = fopen("/dev/null", "w");
+	dup2(fileno(devnull), 1);
+	start = bench_now();
+	sim_main(sim, 15, argv);
+	fflush(stdout);
+	secs = bench_now() - start;
+	dup2(saved_stdout, 1);
+	close(saved_stdout);
+	fclose(devnull);
+	printf("%-36s %12ld events %10.0f events/s\n", "simulation (-w 10 -m 900 -l/-c 0.1)", sim->nevents, sim->nevents / secs);
+}
+
+int main(int argc, char **argv)
+{
+	int sizes[] = {10, 100, 1000};
+	int windows[] = {16, 64, 256, 900};
+	int scan_windows[] = {256, 1024, 4096, 16384, 65536};
+	int i;
+
+	if ((bench_sim = sim_alloc(sim_protocol)) == NULL){
+		perror(argv[0]);
+		return 1;
+	}
+	sim_defaults(bench_sim);
+	printf("benchmark: %s\n", argv[0]);
+	for (i = 0; i < 3; i++)
+		bench_insertevent(sizes[i]);
+	for (i = 0; i < 3; i++)
+		bench_tolayer3(sizes[i]);
+	bench_checksum();
+	bench_wire();
+	for (i = 0; i < 4; i++)
+		bench_window_timeout(windows[i]);
+	for (i = 0; i < 5; i++)
+		bench_window_ack(scan_windows[i], 2);
+	for (i = 0; i < 5; i++)
+		bench_window_ack(scan_windows[i], 64);
+	for (i = 0; i < 5; i++){
+		bench_scan(scan_windows[i], 0);
+		bench_scan(scan_windows[i], 1);
+	}
+	bench_simulation();
+	return 0;
+}
@@ -0,0 +1,147 @@
+/* ******************************************************************
+   Checks that libreliable runs a context again and again without
+   leaking or carrying anything from one run to the next.
+
+   "make check" links this file with libreliable.a. Each protocol's
+   context is given up on by --max-events over and over, at every
+   event count up to CHECK_EVENTS, so sim_exit() leaves sim_run() on
+   timer, layer 5 and layer 3 events alike. The link wraps malloc(),
+   calloc() and free(), so every block the library holds is counted:
+   a context holds two between runs however many have been given up
+   on, and none once it is destroyed. A context run twice to the end
+   must give the same statistics both times.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/reliable.h"
+
+#define CHECK_ROUNDS 50
+#define CHECK_EVENTS 40       /* max_events of the runs given up on: 1 .. CHECK_EVENTS */
+
+const char *check_protocols[] = {"abt", "gbn", "sr"};
+
+/* blocks allocated and not freed, through the -Wl,--wrap of the Makefile */
+long check_live;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+	void *p = __real_malloc(size);
+	check_live += p != NULL;
+	return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	void *p = __real_calloc(n, size);
+	check_live += p != NULL;
+	return p;
+}
+
+void __wrap_free(void *ptr)
+{
+	check_live -= ptr != NULL;
+	__real_free(ptr);
+}
+
+void check_config(struct reliable_config *cfg, const char *protocol)
+{
+	reliable_config_init(cfg);
+	cfg->protocol = protocol;
+	cfg->messages = 20;
+	cfg->loss = 0.2;
+	cfg->corruption = 0.2;
+	cfg->window = 4;
+}
+
+/* one round of runs given up on; returns nonzero if one ends otherwise */
+int check_round(struct reliable_sim *sim, struct reliable_config *cfg, const char *protocol)
+{
+	struct reliable_sim *given_up;
+	int n, code;
+
+	for (n = 1; n <= CHECK_EVENTS; n++){
+		cfg->max_events = n;
+		if ((given_up = reliable_create(cfg)) == NULL){
+			fprintf(stderr, "check_reliable: %s: no context for max_events %d\n", protocol, n);
+			return 1;
+		}
+		code = reliable_run(given_up);
+		reliable_destroy(given_up);
+		if (code != 59){
+			fprintf(stderr, "check_reliable: %s: max_events %d returned %d, not 59\n", protocol, n, code);
+			return 1;
+		}
+	}
+	/* and on one context, given up on in the middle of a run */
+	for (n = 0; n < CHECK_EVENTS; n++){
+		if ((code = reliable_run(sim)) != 59){
+			fprintf(stderr, "check_reliable: %s: a rerun returned %d, not 59\n", protocol, code);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int check_protocol(const char *protocol)
+{
+	struct reliable_config cfg;
+	struct reliable_sim *sim;
+	struct reliable_stats want;
+	long held;
+	int i, ok;
+
+	check_config(&cfg, protocol);
+	cfg.max_events = CHECK_EVENTS / 2;
+	if ((sim = reliable_create(&cfg)) == NULL)
+		return 1;
+	held = check_live;
+	for (i = 0; i < CHECK_ROUNDS; i++){
+		if (check_round(sim, &cfg, protocol)){
+			return 1;
+		}
+		if (check_live != held){
+			fprintf(stderr, "check_reliable: %s: %ld blocks left over after %d rounds of runs given up on\n",
+					protocol, check_live - held, i + 1);
+			return 1;
+		}
+	}
+	reliable_destroy(sim);
+	if (check_live != 0){
+		fprintf(stderr, "check_reliable: %s: %ld blocks left over after reliable_destroy()\n", protocol, check_live);
+		return 1;
+	}
+
+	/* a rerun starts from the state a new context does */
+	check_config(&cfg, protocol);
+	if ((sim = reliable_create(&cfg)) == NULL || reliable_run(sim) != 0)
+		return 1;
+	memcpy(&want, reliable_stats(sim), sizeof(want));
+	ok = reliable_run(sim) == 0 && memcmp(reliable_stats(sim), &want, sizeof(want)) == 0;
+	reliable_destroy(sim);
+	if (!ok){
+		fprintf(stderr, "check_reliable: %s: a rerun differs from the first run\n", protocol);
+		return 1;
+	}
+	printf("check_reliable: %s: %d runs given up on leak nothing, reruns match the first run\n",
+			protocol, CHECK_ROUNDS * 2 * CHECK_EVENTS);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(check_protocols) / sizeof(check_protocols[0]); i++){
+		if (check_protocol(check_protocols[i])){
+			return 1;
+		}
+	}
+	return 0;
+}
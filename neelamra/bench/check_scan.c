@@ -0,0 +1,179 @@
+/* ******************************************************************
+   Checks the window scan kernels of scan.c against their scalar
+   references.
+
+   "make check" links this file with scan.c built for each ISA (AVX2,
+   SSE2 and plain C), so every kernel is checked whichever one the
+   machine would pick. Each run draws CHECK_WINDOWS random windows of
+   up to PROTO_RING packets, many of them wrapping around the end of
+   the ring, with ACKed bitsets from empty to full and send times on
+   both sides of the expiry limit, and stops at the first result that
+   differs from the scalar loop.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../include/proto.h"
+#include "../include/scan.h"
+
+#define CHECK_WINDOWS 20000
+#define CHECK_SEED 1234
+#define CHECK_TIMEOUT 100     /* timerval, with send times in [0, 2 * CHECK_TIMEOUT) */
+#define CHECK_EDGES 256       /* send times per window put at the expiry limit */
+
+double check_time[PROTO_RING];
+/* followed by fully ACKed words, so that a scan reading past the end of */
+/* the ring instead of wrapping around skips the packets at its start    */
+uint64_t check_acked_words[RING_WORDS + 8];
+uint64_t *check_acked = check_acked_words;
+uint64_t check_expired[RING_WORDS];
+uint64_t check_expired_scalar[RING_WORDS];
+uint64_t check_rng;
+
+/* xorshift64, so that a failing window can be drawn again from its seed */
+uint64_t check_rand()
+{
+	check_rng ^= check_rng << 13;
+	check_rng ^= check_rng >> 7;
+	check_rng ^= check_rng << 17;
+	return check_rng;
+}
+
+/* uniform in [0, 1) */
+double check_uniform()
+{
+	return (check_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* ACKed bits by density: 0 none unACKed, 1 all, 2 half, 3 a quarter, */
+/* 4 one in 64, 5 a packet here and there over mostly ACKed words     */
+void check_fill_acked(int density)
+{
+	uint64_t one;
+	int w;
+	for (w = 0; w < RING_WORDS; w++){
+		one = 1ULL << (check_rand() % 64);
+		switch (density){
+		case 0:  check_acked[w] = ~0ULL; break;
+		case 1:  check_acked[w] = 0; break;
+		case 2:  check_acked[w] = check_rand(); break;
+		case 3:  check_acked[w] = check_rand() | check_rand(); break;
+		case 4:  check_acked[w] = ~one; break;
+		default: check_acked[w] = check_rand() % 16 == 0 ? ~one : ~0ULL; break;
+		}
+	}
+}
+
+/* a send time timerval - (curr_time - t) lands near limit for: a few double steps either side */
+double check_edge_time(double curr_time, float timerval, double limit)
+{
+	double t = curr_time - timerval + limit;
+	int k;
+	for (k = (int)(check_rand() % 7) - 3; k < 0; k++){
+		t = nextafter(t, -INFINITY);
+	}
+	for (; k > 0; k--){
+		t = nextafter(t, INFINITY);
+	}
+	return t;
+}
+
+int check_fail(const char *kernel, int n, int from, int to)
+{
+	fprintf(stderr, "check_scan: %s: %s differs from %s_scalar on window %d, [%d, %d)\n",
+			SCAN_ISA, kernel, kernel, n, from, to);
+	return 1;
+}
+
+/* one random window; returns nonzero if a kernel disagrees with its reference */
+int check_window(int n)
+{
+	double curr_time, oldest, limit;
+	float timerval;
+	int from, to, len, i, got, want;
+
+	/* lengths: short, around word multiples, anything, or close to the whole ring */
+	switch (check_rand() % 4){
+	case 0:  len = check_rand() % 130; break;
+	case 1:  len = 64 * (int)(check_rand() % (RING_WORDS + 1)) - 2 + (int)(check_rand() % 5); break;
+	case 2:  len = check_rand() % (PROTO_RING + 1); break;
+	default: len = PROTO_RING - (int)(check_rand() % 130); break;
+	}
+	len = len < 0 ? 0 : len > PROTO_RING ? PROTO_RING : len;
+
+	/* starts: anywhere in a few laps of the ring, or just before its end so the window wraps */
+	if (check_rand() % 2){
+		from = check_rand() % (4 * PROTO_RING);
+	}
+	else {
+		from = (1 + (int)(check_rand() % 3)) * PROTO_RING - (int)(check_rand() % 200);
+	}
+	to = from + len;
+
+	check_fill_acked(check_rand() % 6);
+
+	/* the send times of main() are up to two timeouts old at curr_time; */
+	/* some in the window are moved right to the expiry limit            */
+	curr_time = 2 * CHECK_TIMEOUT;
+	timerval = CHECK_TIMEOUT;
+	limit = check_rand() % 2 ? 0.01 : check_uniform();
+	for (i = 0; len > 0 && i < CHECK_EDGES; i++){
+		check_time[ring_slot(from + (int)(check_rand() % len))] = check_edge_time(curr_time, timerval, limit);
+	}
+
+	oldest = check_rand() % 2 ? curr_time : check_time[ring_slot(from + (int)(check_rand() % (len + 1)))];
+	if (scan_oldest(check_time, check_acked, from, to, oldest) != scan_oldest_scalar(check_time, check_acked, from, to, oldest)){
+		return check_fail("scan_oldest", n, from, to);
+	}
+
+	i = from + (int)(check_rand() % (len + 1));
+	if (scan_next_unacked(check_acked, i, to) != scan_next_unacked_scalar(check_acked, i, to)){
+		return check_fail("scan_next_unacked", n, i, to);
+	}
+
+	if (scan_first_expired(check_time, check_acked, from, to, curr_time, timerval, limit)
+			!= scan_first_expired_scalar(check_time, check_acked, from, to, curr_time, timerval, limit)){
+		return check_fail("scan_first_expired", n, from, to);
+	}
+
+	/* bits already set must be left alone */
+	for (i = 0; i < RING_WORDS; i++){
+		check_expired[i] = check_expired_scalar[i] = check_rand() % 8 == 0 ? check_rand() : 0;
+	}
+	got = scan_expired(check_time, check_acked, from, to, curr_time, timerval, limit, check_expired);
+	want = scan_expired_scalar(check_time, check_acked, from, to, curr_time, timerval, limit, check_expired_scalar);
+	if (got != want || memcmp(check_expired, check_expired_scalar, sizeof(check_expired)) != 0){
+		return check_fail("scan_expired", n, from, to);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int n;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (strcmp(SCAN_ISA, "avx2") == 0 && !__builtin_cpu_supports("avx2")){
+		printf("check_scan: avx2: skipped, the CPU does not have it\n");
+		return 0;
+	}
+#endif
+	check_rng = argc > 1 ? strtoull(argv[1], NULL, 0) : CHECK_SEED;
+	if (check_rng == 0){
+		check_rng = CHECK_SEED;
+	}
+	memset(check_acked_words + RING_WORDS, 0xff, 8 * sizeof(uint64_t));
+	for (n = 0; n < PROTO_RING; n++){
+		check_time[n] = check_uniform() * 2 * CHECK_TIMEOUT;
+	}
+	for (n = 0; n < CHECK_WINDOWS; n++){
+		if (check_window(n)){
+			return 1;
+		}
+	}
+	printf("check_scan: %s: %d windows, every kernel matches its scalar reference\n", SCAN_ISA, CHECK_WINDOWS);
+	return 0;
+}
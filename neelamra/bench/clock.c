@@ -0,0 +1,9 @@
+#include <time.h>
+
+/* kept apart from bench.c, whose included simulator defines a global named time */
+double bench_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,876 @@
+#ifndef ARQ_H_
+#define ARQ_H_
+
+/* ******************************************************************
+   The ARQ engine abt, gbn and sr are made of.
+
+   A protocol is this file included by its .c once it has defined
+   the policies below. They are compile-time constants, so each
+   protocol gets its own copy of the engine with the branches of the
+   other policies folded away and nothing dispatched at run time.
+
+   ARQ_ACK     what an ACK from B means:
+               ARQ_ALTBIT      the alternating bit of the one packet
+                               outstanding (seqnums are 0 and 1)
+               ARQ_CUMULATIVE  every packet up to acknum has arrived,
+                               and B drops what comes out of order
+               ARQ_SELECTIVE   packet acknum has arrived; B buffers
+                               out-of-order packets within its window
+   ARQ_MAXWIN  the largest window: 1 for abt, which ignores -w, or
+               PROTO_RING, the most the simulator accepts for -w.
+               Windowed senders (ARQ_MAXWIN > 1) also get the
+               congestion window, pacing, FEC, flow control and NAKs
+   ARQ_TIMER   how A times its packets:
+               ARQ_TIMER_SINGLE   on the simulator's timer directly
+               ARQ_TIMER_LOGICAL  on the logical timers of timers.h,
+                                  shared with the pacer and the
+                                  persist timer
+   ARQ_RTO     retransmission timeout when --timeout is not given
+   ARQ_PROTOCOL  the name of the struct sim_protocol the simulator
+               drives the protocol through
+
+   A keeps a ring of the packets it was given, [A_base, A_npkts),
+   of which [A_base, A_nextseqnum) have been sent; B delivers in
+   order from B_base on. All of it is in struct arq_state, which the
+   simulator keeps with the rest of a simulation at sim->arq.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "proto.h"
+
+#define ARQ_ALTBIT        0
+#define ARQ_CUMULATIVE    1
+#define ARQ_SELECTIVE     2
+
+#define ARQ_TIMER_SINGLE  0
+#define ARQ_TIMER_LOGICAL 1
+
+#if !defined(ARQ_ACK) || !defined(ARQ_MAXWIN) || !defined(ARQ_TIMER) || !defined(ARQ_RTO) || !defined(ARQ_PROTOCOL)
+#error define ARQ_ACK, ARQ_MAXWIN, ARQ_TIMER, ARQ_RTO and ARQ_PROTOCOL before including arq.h
+#endif
+#if ARQ_MAXWIN < 1 || ARQ_MAXWIN > PROTO_RING
+#error ARQ_MAXWIN must be between 1 and PROTO_RING
+#endif
+#if ARQ_ACK == ARQ_ALTBIT && ARQ_MAXWIN != 1
+#error one bit only tells apart the packets of a window of 1
+#endif
+#if ARQ_MAXWIN > 1 && ARQ_TIMER != ARQ_TIMER_LOGICAL
+#error windowed senders pace and probe on the logical timers
+#endif
+
+#define ARQ_WINDOWED (ARQ_MAXWIN > 1)
+
+#if ARQ_WINDOWED
+#include "cc.h"
+#include "pacer.h"
+#include "fec.h"
+#include "flow.h"
+#include "nak.h"
+#endif
+#if ARQ_TIMER == ARQ_TIMER_LOGICAL
+#include "timers.h"
+#endif
+#if ARQ_ACK == ARQ_SELECTIVE
+#include "scan.h"
+#endif
+
+#define A 0
+#define B 1
+#define TRUE 1
+#define FALSE 0
+#define MSG_LEN PAYLOAD_LEN
+#define RTT 10
+#define min(a,b) (a < b? a:b)
+
+/* the sequence number packet n carries */
+#if ARQ_ACK == ARQ_ALTBIT
+#define ARQ_SEQ(n) ((n) & 1)
+#else
+#define ARQ_SEQ(n) (n)
+#endif
+
+#if ARQ_ACK == ARQ_SELECTIVE
+#define HARQ_BLOCK 8
+#define HARQ_HISTORY 200
+#define HARQ_TARGET 0.01
+#define HARQ_OVERHEAD 4      /* at most one parity packet per HARQ_OVERHEAD data packets */
+#endif
+
+#if ARQ_ACK == ARQ_SELECTIVE
+struct B_dtype{
+	int seqnum;
+	char payload[MSG_LEN];
+	int received;
+};
+#endif
+
+/* everything A and B keep, at sim->arq */
+struct arq_state {
+	int A_base;
+	int A_nextseqnum;
+	int A_npkts;
+	int A_buflen;
+	int A_winsize;
+	float A_timerval;
+
+	int B_base;
+
+	/* sender ring, as parallel arrays: the window scans only touch the ACKed */
+	/* bits and send times, never the packets */
+	struct pkt A_packet[PROTO_RING];
+	double A_start_time[PROTO_RING];   /* time of the last transmission */
+	int A_ntrans[PROTO_RING];
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	int A_harq;
+	int A_harqk;
+	int A_maxacked;
+	float A_nacked;
+	float A_nlate;
+
+	int B_buflen;
+	int B_winsize;
+
+	uint64_t A_acked[RING_WORDS];
+	struct B_dtype B_buffer[PROTO_RING];
+#endif
+};
+
+static void A_sendnew(struct sim_state *sim);
+static void A_rtxtimeout(struct sim_state *sim);
+static void A_reload(struct sim_state *sim);
+#if ARQ_WINDOWED
+static void A_nak(struct sim_state *sim, struct pkt packet);
+static void A_probe(struct sim_state *sim);
+static int B_has(struct sim_state *sim, int seqnum);
+#endif
+#if ARQ_ACK == ARQ_SELECTIVE
+static void A_adapt_parity(struct sim_state *sim, int reordered);
+static void B_reload(struct sim_state *sim);
+#endif
+
+/*************************** POLICY HOOKS ***************************/
+
+/* (re)starts the retransmission timer */
+static inline void A_starttimer(struct sim_state *sim, float increment)
+{
+#if ARQ_TIMER == ARQ_TIMER_LOGICAL
+	lt_start(sim, TIMER_RTX, increment);
+#else
+	starttimer(sim, A, increment);
+#endif
+}
+
+static inline void A_stoptimer(struct sim_state *sim)
+{
+#if ARQ_TIMER == ARQ_TIMER_LOGICAL
+	lt_stop(sim, TIMER_RTX);
+#else
+	stoptimer(sim, A);
+#endif
+}
+
+/* puts packet seqnum on its way to B, noting the time */
+static inline void A_transmit(struct sim_state *sim, int seqnum)
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_WINDOWED
+	pacer_send(sim, &arq->A_packet[ring_slot(seqnum)], &arq->A_start_time[ring_slot(seqnum)]);
+#else
+	arq->A_start_time[ring_slot(seqnum)] = get_sim_time(sim);
+	tolayer3(sim, A, arq->A_packet[ring_slot(seqnum)]);
+#endif
+}
+
+/* first sequence number past the window A may send in */
+static inline int A_limit(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_WINDOWED
+	return flow_limit(sim, arq->A_base + cc_window(sim));
+#else
+	return arq->A_base + ARQ_MAXWIN;
+#endif
+}
+
+/**
+ * function for finding the earliest send time of the unACKed packets in the window
+ *
+ * @param curr_time Returned if every packet in the window is ACKed
+ * @return The earliest send time, or curr_time
+ */
+static inline double A_oldest(struct sim_state *sim, double curr_time)
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	return scan_oldest(arq->A_start_time, arq->A_acked, arq->A_base, min(arq->A_nextseqnum, arq->A_base + arq->A_winsize), curr_time);
+#else
+	return arq->A_base < arq->A_nextseqnum ? arq->A_start_time[ring_slot(arq->A_base)] : curr_time;
+#endif
+}
+
+/* whether B has room for packet seqnum, the next one it delivers or within its window */
+static inline int B_fits(struct sim_state *sim, int seqnum)
+{
+#if ARQ_WINDOWED
+	struct arq_state *arq = sim->arq;
+
+	return flow_fits(sim, seqnum, arq->B_base);
+#else
+	/* a full receive buffer turns the packet away; A's retransmissions probe until it drains */
+	return getrcvbuf(sim) == 0 || getrcvfree(sim) > 0;
+#endif
+}
+
+/* sends A an ACK for acknum, with the window B advertises */
+static void B_ack(struct sim_state *sim, int acknum)
+{
+	struct pkt ack;
+#if ARQ_WINDOWED
+	struct arq_state *arq = sim->arq;
+
+	ack.seqnum = flow_edge(sim, arq->B_base);
+#else
+	ack.seqnum = 1;
+#endif
+	ack.acknum = acknum;
+	memset(ack.payload, 0, MSG_LEN);   /* ACKs carry no payload */
+	ack.checksum = compute_checksum(ack.seqnum, ack.acknum, ack.payload);
+	tolayer3(sim, B, ack);
+}
+
+/*************************** SENDER ***************************/
+
+/* sends packet seqnum, counting the first transmission for the queueing delay */
+static void A_send(struct sim_state *sim, int seqnum)
+{
+	struct arq_state *arq = sim->arq;
+
+	if (arq->A_ntrans[ring_slot(seqnum)]++ == 0){
+		report_send(sim, A);
+	}
+	A_transmit(sim, seqnum);
+}
+
+static void A_resend(struct sim_state *sim, int seqnum)
+{
+	struct arq_state *arq = sim->arq;
+
+	arq->A_ntrans[ring_slot(seqnum)]++;
+	A_transmit(sim, seqnum);
+	report_retransmit(sim, A);
+}
+
+/* sends packet A_nextseqnum, which the window has room for */
+static void A_sendnext(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	A_send(sim, arq->A_nextseqnum);
+#if ARQ_WINDOWED
+	fec_output(sim, &arq->A_packet[ring_slot(arq->A_nextseqnum)]);
+#endif
+	if (arq->A_nextseqnum == arq->A_base){
+		A_starttimer(sim, arq->A_timerval);
+	}
+	arq->A_nextseqnum++;
+}
+
+/* called after sending: the persist timer and the reported window follow what is outstanding */
+static void A_idle(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_WINDOWED
+	flow_idle(sim, arq->A_nextseqnum, arq->A_npkts, arq->A_nextseqnum - arq->A_base);
+#endif
+	report_window(sim, A, arq->A_nextseqnum - arq->A_base);
+}
+
+/********* STUDENTS WRITE THE NEXT SIX ROUTINES *********/
+
+/* called from layer 5, passed the data to be sent to other side */
+static void A_output(sim, message)
+	struct sim_state *sim;
+	struct msg message;
+{
+	struct arq_state *arq = sim->arq;
+	struct pkt *packet = &arq->A_packet[ring_slot(arq->A_npkts)];
+
+	/* the buffer is a ring: every unacknowledged packet needs its own slot */
+	if (arq->A_buflen == PROTO_RING){
+		if (sim->TRACE >= 0){
+			printf("PANIC: more than %d packets buffered at the sender!", PROTO_RING);
+		}
+		sim_exit(sim, 56);
+	}
+
+	/* making a packet for the message and storing it in a local buffer */
+	packet->seqnum = ARQ_SEQ(arq->A_npkts);
+	packet->acknum = 1;
+	memcpy(packet->payload, message.data, MSG_LEN);
+	packet->checksum = compute_checksum(packet->seqnum, packet->acknum, packet->payload);
+#if ARQ_ACK == ARQ_SELECTIVE
+	ring_bit_clear(arq->A_acked, arq->A_npkts);
+#endif
+	arq->A_ntrans[ring_slot(arq->A_npkts)] = 0;
+	arq->A_buflen++;
+	arq->A_npkts++;
+	report_backlog(sim, A, arq->A_buflen);
+
+	/* sending the oldest packet not sent yet if it falls in the current window */
+	if (arq->A_nextseqnum < A_limit(sim)){
+		A_sendnext(sim);
+	}
+	A_idle(sim);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 */
+static void A_input(sim, packet)
+	struct sim_state *sim;
+	struct pkt packet;
+{
+	struct arq_state *arq = sim->arq;
+	int prevbase;
+#if ARQ_WINDOWED
+	int opened;
+#endif
+
+#if ARQ_ACK == ARQ_ALTBIT
+	/* ignoring duplicate acknowledgements */
+	if (arq->A_base == arq->A_nextseqnum){
+		return;
+	}
+
+	/* resending at once on a corrupt ACK or one for the previous packet */
+	if (!validate_checksum(packet) || packet.acknum != ARQ_SEQ(arq->A_base)){
+		A_stoptimer(sim);
+		A_resend(sim, arq->A_base);
+		A_starttimer(sim, arq->A_timerval);
+		return;
+	}
+	packet.acknum = arq->A_base;
+#else
+	/* validating the checksum */
+	if (!validate_checksum(packet)){
+		return;
+	}
+
+#if ARQ_WINDOWED
+	/* resending at once what a NAK reports missing */
+	if (nak_is(packet)){
+		A_nak(sim, packet);
+		return;
+	}
+
+	/* taking B's advertised window, which duplicate ACKs carry as well */
+	opened = flow_ack(sim, packet.seqnum);
+
+	/* ignoring duplicate acknowledgements, unless they open the window */
+	if (packet.acknum < arq->A_base){
+		if (opened){
+			A_sendnew(sim);
+		}
+		return;
+	}
+#else
+	if (packet.acknum < arq->A_base){
+		return;
+	}
+#endif
+#endif
+	if (packet.acknum >= arq->A_nextseqnum){
+		/* B took a zero-window probe */
+		arq->A_nextseqnum = packet.acknum + 1;
+	}
+
+	prevbase = arq->A_base;
+#if ARQ_ACK == ARQ_SELECTIVE
+	/* marking the packet as acknowledged */
+	if (!ring_bit_test(arq->A_acked, packet.acknum)){
+		cc_on_ack(sim, 1);
+		if (arq->A_ntrans[ring_slot(packet.acknum)] == 1){
+			pacer_rtt_sample(sim, get_sim_time(sim) - arq->A_start_time[ring_slot(packet.acknum)]);
+		}
+		if (arq->A_harq){
+			A_adapt_parity(sim, packet.acknum < arq->A_maxacked);
+		}
+		if (packet.acknum > arq->A_maxacked){
+			arq->A_maxacked = packet.acknum;
+		}
+	}
+	ring_bit_set(arq->A_acked, packet.acknum);
+
+	/* verifying if the sender base has to be moved to the right */
+	if (packet.acknum == arq->A_base){
+		arq->A_base = scan_next_unacked(arq->A_acked, arq->A_base + 1, arq->A_nextseqnum);
+	}
+#else
+#if ARQ_WINDOWED
+	/* sampling the round trip time of packets sent only once */
+	if (arq->A_ntrans[ring_slot(packet.acknum)] == 1){
+		pacer_rtt_sample(sim, get_sim_time(sim) - arq->A_start_time[ring_slot(packet.acknum)]);
+	}
+#endif
+	/* moving sender base past every packet the ACK covers */
+	arq->A_base = packet.acknum + 1;
+#endif
+
+	/* stopping the timer, or restarting it for the oldest packet still unACKed */
+	A_stoptimer(sim);
+	if (arq->A_base != arq->A_nextseqnum){
+		double curr_time = get_sim_time(sim);
+		float timerval = arq->A_timerval - (curr_time - A_oldest(sim, curr_time));
+		A_starttimer(sim, timerval);
+	}
+	arq->A_buflen -= arq->A_base - prevbase;
+	report_backlog(sim, A, arq->A_buflen);
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	/* transmitting next packets (if any) in buffer if the window has moved to the right */
+	if ((arq->A_base == prevbase && !opened) || arq->A_buflen == 0){
+		report_window(sim, A, arq->A_nextseqnum - arq->A_base);
+		return;
+	}
+#elif ARQ_WINDOWED
+	cc_on_ack(sim, arq->A_base - prevbase);
+#endif
+	A_sendnew(sim);
+}
+
+/* transmitting buffered packets that fall in the current window */
+static void A_sendnew(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	while (arq->A_nextseqnum < min(arq->A_npkts, A_limit(sim))){
+		A_sendnext(sim);
+	}
+	A_idle(sim);
+}
+
+/* called when A's timer goes off */
+static void A_timerinterrupt(struct sim_state *sim)
+{
+#if ARQ_TIMER == ARQ_TIMER_LOGICAL
+	int id;
+	lt_interrupt(sim);
+	while ((id = lt_expire(sim)) != -1){
+		if (id == TIMER_RTX){
+			A_rtxtimeout(sim);
+		}
+		else if (id == TIMER_PACE){
+			pacer_timeout(sim);
+		}
+		else if (id == TIMER_PERSIST){
+			A_probe(sim);
+		}
+	}
+#else
+	A_rtxtimeout(sim);
+#endif
+}
+
+/* called when the retransmission timer goes off */
+static void A_rtxtimeout(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	/* finding the packet whose timer expired; one is resent per timeout, and */
+	/* the timer, set from the oldest left, goes off again at once for the next */
+	double curr_time = get_sim_time(sim);
+	int pkt_idx = scan_first_expired(arq->A_start_time, arq->A_acked, arq->A_base, arq->A_nextseqnum, curr_time, arq->A_timerval, 0.01);
+	double oldest_time;
+
+	/* none has: the timer went off before the oldest packet's deadline (a */
+	/* paced packet leaves after its timer is set), so nothing is resent   */
+	if (pkt_idx == arq->A_nextseqnum){
+		if (arq->A_base < arq->A_nextseqnum){
+			oldest_time = A_oldest(sim, curr_time);
+			A_starttimer(sim, arq->A_timerval - (curr_time - oldest_time));
+		}
+		return;
+	}
+
+	/* shrinking the congestion window */
+	cc_on_loss(sim, arq->A_start_time[ring_slot(pkt_idx)]);
+
+	/* retransmitting the packet */
+	A_resend(sim, pkt_idx);
+
+	/* updating the timer */
+	oldest_time = A_oldest(sim, curr_time);
+	if (oldest_time == curr_time){
+		A_starttimer(sim, arq->A_timerval);
+	}
+	else {
+		float timerval = arq->A_timerval - (curr_time - oldest_time);
+		A_starttimer(sim, timerval);
+	}
+#else
+	int i;
+
+#if ARQ_WINDOWED
+	/* shrinking the congestion window */
+	cc_on_loss(sim, arq->A_start_time[ring_slot(arq->A_base)]);
+	pacer_flush(sim);
+#endif
+
+	/* retransmitting all the packets in the window */
+	for (i = arq->A_base; i < arq->A_nextseqnum; i++){
+		A_resend(sim, i);
+		if (i == arq->A_base){
+			A_starttimer(sim, arq->A_timerval);
+		}
+	}
+#endif
+}
+
+#if ARQ_WINDOWED
+#if ARQ_ACK == ARQ_SELECTIVE
+/* called for a NAK: resending the unACKed packets it lists */
+static void A_nak(sim, packet)
+	struct sim_state *sim;
+	struct pkt packet;
+{
+	struct arq_state *arq = sim->arq;
+	int seqnums[NAK_SPAN];
+	int i, n, seq, resent = FALSE;
+
+	n = nak_list(packet, seqnums);
+	for (i = 0; i < n; i++){
+		seq = seqnums[i];
+		if (seq < arq->A_base || seq >= arq->A_nextseqnum || ring_bit_test(arq->A_acked, seq)){
+			continue;
+		}
+		/* a retransmission less than a timeout old may still be on its way */
+		if (arq->A_ntrans[ring_slot(seq)] > 1 && get_sim_time(sim) - arq->A_start_time[ring_slot(seq)] < arq->A_timerval){
+			continue;
+		}
+		cc_on_loss(sim, arq->A_start_time[ring_slot(seq)]);
+		A_resend(sim, seq);
+		resent = TRUE;
+	}
+
+	/* the timer runs for the oldest transmission, which may have been one of these */
+	if (resent){
+		double curr_time = get_sim_time(sim);
+		A_starttimer(sim, arq->A_timerval - (curr_time - A_oldest(sim, curr_time)));
+	}
+}
+#else
+/* called for a NAK: B discarded everything from the first packet it misses on, so going back to it */
+static void A_nak(sim, packet)
+	struct sim_state *sim;
+	struct pkt packet;
+{
+	struct arq_state *arq = sim->arq;
+	int i, from = packet.seqnum;
+
+	if (from < arq->A_base || from >= arq->A_nextseqnum){
+		return;
+	}
+	/* a retransmission less than a timeout old may still be on its way */
+	if (arq->A_ntrans[ring_slot(from)] > 1 && get_sim_time(sim) - arq->A_start_time[ring_slot(from)] < arq->A_timerval){
+		return;
+	}
+	cc_on_loss(sim, arq->A_start_time[ring_slot(from)]);
+	pacer_flush(sim);
+	for (i = from; i < arq->A_nextseqnum; i++){
+		A_resend(sim, i);
+	}
+	if (from == arq->A_base){
+		A_starttimer(sim, arq->A_timerval);
+	}
+}
+#endif
+
+/* called when the persist timer goes off: probing B's closed window with the next packet */
+static void A_probe(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	if (flow_persist(sim, arq->A_nextseqnum, arq->A_npkts, arq->A_nextseqnum - arq->A_base)){
+		A_send(sim, arq->A_nextseqnum);
+	}
+}
+#endif
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+static void A_init(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	arq->A_base = 0;
+	arq->A_nextseqnum = 0;
+	arq->A_npkts = 0;
+	arq->A_buflen = 0;
+	arq->A_winsize = min(getwinsize(sim), ARQ_MAXWIN);
+	arq->A_timerval = gettimeout(sim) > 0 ? gettimeout(sim) : ARQ_RTO;
+#if ARQ_WINDOWED
+	cc_init(sim, getccmode(sim), arq->A_winsize);
+	lt_init(sim);
+	pacer_init(sim, getpacerate(sim), RTT);
+#if ARQ_ACK == ARQ_SELECTIVE
+	arq->A_harq = getharq(sim);
+	arq->A_harqk = getfeck(sim) > 0 ? getfeck(sim) : HARQ_BLOCK;
+	arq->A_maxacked = -1;
+	arq->A_nacked = 0;
+	arq->A_nlate = 0;
+	if (arq->A_harq){
+		fec_init(sim, arq->A_harqk, 0);
+	}
+	else {
+		fec_init(sim, getfeck(sim), getfecm(sim));
+	}
+#else
+	fec_init(sim, getfeck(sim), getfecm(sim));
+#endif
+	flow_init(sim, arq->A_timerval);
+#endif
+	SAVE_STATE(sim, arq->A_base);
+	SAVE_STATE(sim, arq->A_nextseqnum);
+	SAVE_STATE(sim, arq->A_npkts);
+	SAVE_STATE(sim, arq->A_buflen);
+	SAVE_STATE(sim, arq->A_packet);
+	SAVE_STATE(sim, arq->A_start_time);
+	SAVE_STATE(sim, arq->A_ntrans);
+#if ARQ_ACK == ARQ_SELECTIVE
+	SAVE_STATE(sim, arq->A_acked);
+	SAVE_STATE(sim, arq->A_maxacked);
+	SAVE_STATE(sim, arq->A_nacked);
+	SAVE_STATE(sim, arq->A_nlate);
+#endif
+	register_reload(sim, A_reload);
+}
+
+/* re-reads the window and timeout when a what-if branch changes them */
+static void A_reload(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	arq->A_winsize = min(getwinsize(sim), ARQ_MAXWIN);
+	arq->A_timerval = gettimeout(sim) > 0 ? gettimeout(sim) : ARQ_RTO;
+#if ARQ_WINDOWED
+	cc_set_maxwin(sim, arq->A_winsize);
+#endif
+}
+
+#if ARQ_ACK == ARQ_SELECTIVE
+/**
+ * function for choosing the parity of the next FEC blocks from ACK feedback
+ *
+ * The channel does not reorder, so a packet ACKed after a later one was
+ * lost on its first trip (or its ACK was) and got through by FEC or by a
+ * retransmission. Spurious timeouts do not count: their original ACK still
+ * arrives in order. The parity count is the smallest m for which a block of
+ * A_harqk + m packets at the estimated loss rate loses more than m packets
+ * with probability below HARQ_TARGET, capped so that parity does not
+ * load the channel into more timeouts than it saves.
+ *
+ * @param reordered Whether a later packet was ACKed first
+ */
+static void A_adapt_parity(struct sim_state *sim, int reordered)
+{
+	struct arq_state *arq = sim->arq;
+	int m, n, i;
+	double p, pmf, tail;
+
+	arq->A_nacked += 1;
+	arq->A_nlate += reordered;
+	if (arq->A_nacked > HARQ_HISTORY){
+		arq->A_nacked /= 2;
+		arq->A_nlate /= 2;
+	}
+
+	p = arq->A_nlate / arq->A_nacked;
+	for (m = 0; m < arq->A_harqk / HARQ_OVERHEAD && m < FEC_MAXM; m++){
+		/* P(more than m of the n packets of a block are lost) */
+		n = arq->A_harqk + m;
+		pmf = 1.0;
+		for (i = 0; i < n; i++){
+			pmf *= 1 - p;
+		}
+		tail = 1.0 - pmf;
+		for (i = 1; i <= m && p < 1.0; i++){
+			pmf *= (double)(n - i + 1) / i * p / (1 - p);
+			tail -= pmf;
+		}
+		if (tail < HARQ_TARGET){
+			break;
+		}
+	}
+	fec_set_parity(sim, m);
+}
+#endif
+
+/*************************** RECEIVER ***************************/
+
+/* Note that with simplex transfer from A-to-B, there is no B_output() */
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+static void B_input(sim, packet)
+	struct sim_state *sim;
+	struct pkt packet;
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_WINDOWED
+	/* passing the packet through the FEC layer, which consumes parity packets */
+	if (fec_input(sim, packet, B_input)){
+		return;
+	}
+#endif
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	/* validating checksum of the received packet */
+	if (!validate_checksum(packet)){
+		return;
+	}
+
+	/* ignoring unexpected packets falling out of window */
+	if ((packet.seqnum < arq->B_base - arq->B_winsize) || (packet.seqnum >= arq->B_base + arq->B_winsize)){
+		return;
+	}
+
+	/* refusing packets past the end of the receive buffer, B's advertised window */
+	int fits = B_fits(sim, packet.seqnum);
+
+	/* ACKing the packet, or the last one delivered if it does not fit */
+	B_ack(sim, fits ? packet.seqnum : arq->B_base - 1);
+	if (packet.seqnum < arq->B_base || !fits){
+		return;
+	}
+
+	/* storing the received packet data in a local buffer */
+	int idx = ring_slot(packet.seqnum);
+	arq->B_buffer[idx].seqnum = packet.seqnum;
+	memcpy(arq->B_buffer[idx].payload, packet.payload, MSG_LEN);
+	arq->B_buffer[idx].received = TRUE;
+	arq->B_buflen++;
+
+	/* delivering data to layer 5 of host B if packet(s) in the buffer is/are in-order */
+	if (packet.seqnum == arq->B_base){
+		int i;
+		for (i = arq->B_base; i < arq->B_base + arq->B_winsize; i++){
+			if (!arq->B_buffer[ring_slot(i)].received){
+				break;
+			}
+			char payload[MSG_LEN];
+			memcpy(payload, arq->B_buffer[ring_slot(i)].payload, sizeof(payload));
+			arq->B_buffer[ring_slot(i)].received = FALSE;    /* freeing the slot for seqnum i + PROTO_RING */
+			tolayer5(sim, B, payload);
+		}
+		arq->B_base = i;
+	}
+
+	/* a packet buffered past a hole */
+	if (packet.seqnum >= arq->B_base){
+		nak_gap(sim, arq->B_base, packet.seqnum);
+	}
+#else
+	/* validating checksum of the received packet */
+	int is_crpt = !validate_checksum(packet);
+
+	/* taking the packet if it is neither out-of-order nor corrupt, and fits in the receive buffer */
+	int take = !is_crpt && packet.seqnum == ARQ_SEQ(arq->B_base) && B_fits(sim, packet.seqnum);
+
+	/* ACKing the packet, or the last one delivered if it is not taken */
+	B_ack(sim, take ? packet.seqnum : ARQ_SEQ(arq->B_base - 1));
+
+	/* delivering data to layer 5 of host B */
+	if (take){
+		char payload[MSG_LEN];
+		memcpy(payload, packet.payload, sizeof(payload));
+		tolayer5(sim, B, payload);
+		arq->B_base++;
+	}
+#if ARQ_WINDOWED
+	else if (!is_crpt && packet.seqnum > arq->B_base){
+		/* a packet past a hole */
+		nak_gap(sim, arq->B_base, packet.seqnum);
+	}
+#endif
+#endif
+}
+
+/* called when B's timer goes off, for a NAK held back; abt never starts it */
+static void B_timerinterrupt(struct sim_state *sim)
+{
+#if ARQ_WINDOWED
+	struct arq_state *arq = sim->arq;
+
+	nak_timeout(sim, arq->B_base);
+#endif
+}
+
+#if ARQ_WINDOWED
+/* whether B holds or has delivered seqnum */
+static int B_has(sim, seqnum)
+	struct sim_state *sim;
+	int seqnum;
+{
+	struct arq_state *arq = sim->arq;
+
+#if ARQ_ACK == ARQ_SELECTIVE
+	return seqnum < arq->B_base || (arq->B_buffer[ring_slot(seqnum)].received && arq->B_buffer[ring_slot(seqnum)].seqnum == seqnum);
+#else
+	return seqnum < arq->B_base;
+#endif
+}
+#endif
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+static void B_init(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	arq->B_base = 0;
+#if ARQ_ACK == ARQ_SELECTIVE
+	arq->B_buflen = 0;
+	arq->B_winsize = min(getwinsize(sim), ARQ_MAXWIN);
+#endif
+#if ARQ_WINDOWED
+	nak_init(sim, gettimeout(sim) > 0 ? gettimeout(sim) : ARQ_RTO, B_has);
+#endif
+	SAVE_STATE(sim, arq->B_base);
+#if ARQ_ACK == ARQ_SELECTIVE
+	SAVE_STATE(sim, arq->B_buflen);
+	SAVE_STATE(sim, arq->B_buffer);
+	register_reload(sim, B_reload);
+#endif
+}
+
+#if ARQ_ACK == ARQ_SELECTIVE
+/* re-reads the window when a what-if branch changes it */
+static void B_reload(struct sim_state *sim)
+{
+	struct arq_state *arq = sim->arq;
+
+	arq->B_winsize = min(getwinsize(sim), ARQ_MAXWIN);
+}
+#endif
+
+/* the protocol, as the simulator drives it */
+const struct sim_protocol ARQ_PROTOCOL = {
+	sizeof(struct arq_state),
+	A_output, A_input, A_timerinterrupt, A_init,
+	B_input, B_timerinterrupt, B_init
+};
+
+#ifndef RELIABLE_LIB
+/* the protocol the program simulates, when it is built as one */
+const struct sim_protocol *const sim_protocol = &ARQ_PROTOCOL;
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef CC_H_
+#define CC_H_
+
+/* congestion control algorithms selectable with --cc */
+#define CC_NONE  0
+#define CC_AIMD  1
+#define CC_CUBIC 2
+
+#include "simulator.h"
+
+/* Congestion window shared by the windowed senders (gbn, sr). The    */
+/* window the sender may use is min(cwnd, maximum window given to     */
+/* cc_init()), so CC_NONE behaves exactly like a fixed -w window.     */
+struct cc_state {
+	int mode;
+	int maxwin;
+	float congwin;
+	float ssthresh;
+	float wmax;
+	double epoch;
+	float K;
+	double last_loss;
+};
+
+void cc_init(struct sim_state *sim, int mode, int maxwin);
+void cc_on_ack(struct sim_state *sim, int nacked);
+void cc_on_loss(struct sim_state *sim, double sent_time);
+int cc_window(struct sim_state *sim);
+float cc_cwnd(struct sim_state *sim);
+void cc_set_maxwin(struct sim_state *sim, int maxwin);
+
+#endif
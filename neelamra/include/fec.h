@@ -0,0 +1,42 @@
+#ifndef FEC_H_
+#define FEC_H_
+
+#include "simulator.h"
+
+#define FEC_MAXK 32
+#define FEC_MAXM 8
+#define FEC_NBLOCKS 64     /* blocks the sender and the receiver keep */
+
+/* Forward error correction over blocks of k consecutive data packets. */
+/* Parity packets carry the block number in seqnum and a negative      */
+/* acknum encoding the parity index and the block's parity count.      */
+struct fec_rxblock {
+	int block;                          /* block number held in this slot */
+	int done;                           /* all k payloads known */
+	int m;                              /* parity packets sent for the block */
+	int present[FEC_MAXK];
+	char data[FEC_MAXK][PAYLOAD_LEN];
+	int nparity;
+	int parity_idx[FEC_MAXM];
+	char parity[FEC_MAXM][PAYLOAD_LEN];
+};
+
+struct fec_state {
+	int k;
+	int m;              /* parity packets per block sent from now on, 0 = off */
+	int nrecovered;
+	unsigned char gf_exp[512];
+	unsigned char gf_log[256];
+	char txdata[FEC_MAXK][PAYLOAD_LEN];
+	struct pkt txparity[FEC_NBLOCKS][FEC_MAXM];
+	double txtime[FEC_NBLOCKS][FEC_MAXM];
+	struct fec_rxblock rx[FEC_NBLOCKS];
+};
+
+void fec_init(struct sim_state *sim, int k, int m);
+void fec_set_parity(struct sim_state *sim, int m);
+void fec_output(struct sim_state *sim, struct pkt *packet);
+int fec_input(struct sim_state *sim, struct pkt packet, void (*deliver)(struct sim_state *sim, struct pkt));
+int fec_recovered(struct sim_state *sim);
+
+#endif
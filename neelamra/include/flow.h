@@ -0,0 +1,26 @@
+#ifndef FLOW_H_
+#define FLOW_H_
+
+#include "simulator.h"
+
+/* Flow control of the windowed senders (gbn, sr) by the window B       */
+/* advertises. ACKs carry B's window edge, the first sequence number    */
+/* that does not fit in its receive buffer, in their otherwise unused   */
+/* seqnum. Without a receive buffer (getrcvbuf() == 0) nothing changes: */
+/* ACKs keep seqnum 1 and the sender ignores it.                        */
+struct flow_state {
+	int on;
+	int window;          /* first sequence number past B's advertised window */
+	float rto;
+	float interval;      /* time to the next zero-window probe */
+};
+
+void flow_init(struct sim_state *sim, float rto);
+int flow_ack(struct sim_state *sim, int edge);
+int flow_limit(struct sim_state *sim, int limit);
+void flow_idle(struct sim_state *sim, int nextseqnum, int npkts, int inflight);
+int flow_persist(struct sim_state *sim, int nextseqnum, int npkts, int inflight);
+int flow_fits(struct sim_state *sim, int seqnum, int expected);
+int flow_edge(struct sim_state *sim, int expected);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HDR_H_
+#define HDR_H_
+
+#include <stdint.h>
+
+/* HDR-style histogram: exact below 2^HDR_SUB_BITS, and 2^(HDR_SUB_BITS-1) */
+/* linear buckets per power of two above, i.e. under 1% relative error    */
+/* for any 64-bit value in a fixed ~60KB.                                  */
+#define HDR_SUB_BITS 8
+#define HDR_NBUCKETS ((66 - HDR_SUB_BITS) << (HDR_SUB_BITS - 1))
+
+struct hdr_hist {
+	uint64_t counts[HDR_NBUCKETS];
+	uint64_t total;
+	uint64_t max;
+};
+
+void hdr_init(struct hdr_hist *h);
+void hdr_record(struct hdr_hist *h, uint64_t value);
+uint64_t hdr_percentile(const struct hdr_hist *h, double percentile);
+void hdr_merge(struct hdr_hist *dst, const struct hdr_hist *src);
+
+#endif
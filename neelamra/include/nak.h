@@ -0,0 +1,32 @@
+#ifndef NAK_H_
+#define NAK_H_
+
+#include "simulator.h"
+
+/* NAKs of the windowed protocols (gbn, sr), on with --nak. A NAK is a  */
+/* packet from B with acknum NAK_ACKNUM (real ACKs never go below -1),  */
+/* the first sequence number B is missing in seqnum and a bitmap of the */
+/* next NAK_SPAN - 1 sequence numbers, set for each one also missing,   */
+/* in its payload. B sends one when it sees a hole, and then at most    */
+/* one per retransmission timeout while holes remain, on its own timer. */
+#define NAK_ACKNUM (-2)
+#define NAK_SPAN (1 + 8 * PAYLOAD_LEN)
+
+struct nak_state {
+	int on;
+	float rto;
+	float interval;      /* hold-off after the last NAK */
+	int first;           /* first sequence number the last NAK listed */
+	int (*has)(struct sim_state *sim, int seqnum);
+	int high;            /* one past the highest sequence number B has seen */
+	double next;         /* earliest time B may send another NAK */
+	int armed;           /* whether B's timer is running for a held back NAK */
+};
+
+void nak_init(struct sim_state *sim, float rto, int (*has)(struct sim_state *sim, int seqnum));
+void nak_gap(struct sim_state *sim, int expected, int seen);
+void nak_timeout(struct sim_state *sim, int expected);
+int nak_is(struct pkt packet);
+int nak_list(struct pkt packet, int *seqnums);
+
+#endif
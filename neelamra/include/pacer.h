@@ -0,0 +1,32 @@
+#ifndef PACER_H_
+#define PACER_H_
+
+#include <stddef.h>
+
+#include "simulator.h"
+
+/* Sender-side pacer of entity A. With pacing off (getpacerate() < 0) */
+/* pacer_send() hands packets straight to tolayer3().                 */
+#define PACER_QSIZE 4096
+
+struct pacer_entry {
+	ptrdiff_t packet;     /* offsets from the queue */
+	ptrdiff_t sent_time;
+};
+
+struct pacer_state {
+	struct pacer_entry queue[PACER_QSIZE];
+	int head;
+	int len;
+	float rate;           /* < 0 off, 0 adaptive, > 0 packets per time unit */
+	float srtt;
+	double next;          /* earliest time the next packet may leave */
+};
+
+void pacer_init(struct sim_state *sim, float rate, float srtt);
+void pacer_send(struct sim_state *sim, struct pkt *packet, double *sent_time);
+void pacer_flush(struct sim_state *sim);
+void pacer_timeout(struct sim_state *sim);
+void pacer_rtt_sample(struct sim_state *sim, float rtt);
+
+#endif
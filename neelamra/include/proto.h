@@ -0,0 +1,122 @@
+#ifndef PROTO_H_
+#define PROTO_H_
+
+#include <stdint.h>
+
+#include "simulator.h"
+
+/* Pieces shared by abt, gbn and sr: packet checksums and the arithmetic */
+/* of the buffers indexed by sequence number. Everything here is static  */
+/* inline and chosen at compile time, so each protocol gets its own      */
+/* specialized copy with nothing left to dispatch at run time.           */
+
+/* packet checksum, chosen with "make CHECKSUM=sum|inet" */
+#define CHECKSUM_SUM  0      /* sum of the payload bytes and header fields */
+#define CHECKSUM_INET 1      /* 16-bit ones' complement sum (RFC 1071) */
+#ifndef PROTO_CHECKSUM
+#define PROTO_CHECKSUM CHECKSUM_SUM
+#endif
+
+/* packets the sender and receiver buffers hold, a power of two */
+#define PROTO_RING 65536
+#if PROTO_RING & (PROTO_RING - 1)
+#error PROTO_RING must be a power of two
+#endif
+
+/* slot of a sequence number in a ring of PROTO_RING packets */
+static inline int ring_slot(int seqnum)
+{
+	return seqnum & (PROTO_RING - 1);
+}
+
+/* bitsets with a bit per ring slot, so flags can be scanned a word at a time */
+#define RING_WORDS (PROTO_RING / 64)
+
+static inline void ring_bit_set(uint64_t *bits, int seqnum)
+{
+	bits[ring_slot(seqnum) >> 6] |= 1ULL << (seqnum & 63);
+}
+
+static inline void ring_bit_clear(uint64_t *bits, int seqnum)
+{
+	bits[ring_slot(seqnum) >> 6] &= ~(1ULL << (seqnum & 63));
+}
+
+static inline int ring_bit_test(const uint64_t *bits, int seqnum)
+{
+	return (bits[ring_slot(seqnum) >> 6] >> (seqnum & 63)) & 1;
+}
+
+/* clear bits for sequence numbers from, from + 1, ... up to the end of its */
+/* word or to, whichever comes first; bit 0 stands for from                */
+static inline uint64_t ring_clear_bits(const uint64_t *bits, int from, int to)
+{
+	uint64_t word = ~bits[ring_slot(from) >> 6] >> (from & 63);
+	if (to - from < 64){
+		word &= (1ULL << (to - from)) - 1;
+	}
+	return word;
+}
+
+/* first sequence number in [from, to) whose bit is clear, or to if none */
+static inline int ring_next_clear(const uint64_t *bits, int from, int to)
+{
+	uint64_t word;
+	while (from < to){
+		word = ~bits[ring_slot(from) >> 6] >> (from & 63);
+		if (word != 0){
+			from += __builtin_ctzll(word);
+			return from < to ? from : to;
+		}
+		from += 64 - (from & 63);
+	}
+	return to;
+}
+
+/**
+ * function for calculating checksum
+ *
+ * @param seqnum Sequence number
+ * @param acknum Acknowledgement number
+ * @param payload Payload
+ * @return checksum Checksum
+ */
+static inline int compute_checksum(int seqnum, int acknum, const char *payload)
+{
+	int i;
+#if PROTO_CHECKSUM == CHECKSUM_INET
+	uint32_t sum = 0;
+	for (i = 0; i + 1 < PAYLOAD_LEN; i += 2){
+		sum += ((unsigned char)payload[i] << 8) | (unsigned char)payload[i + 1];
+	}
+	if (PAYLOAD_LEN % 2){
+		sum += (unsigned char)payload[PAYLOAD_LEN - 1] << 8;
+	}
+	sum += ((uint32_t)seqnum >> 16) + ((uint32_t)seqnum & 0xffff);
+	sum += ((uint32_t)acknum >> 16) + ((uint32_t)acknum & 0xffff);
+	while (sum >> 16){
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return ~sum & 0xffff;
+#else
+	int checksum = 0;
+	for (i = 0; i < PAYLOAD_LEN; i++){
+		checksum += payload[i];
+	}
+	checksum += seqnum + acknum;
+	return checksum;
+#endif
+}
+
+/**
+ * function for validating checksum
+ *
+ * @param packet Received packet
+ * @return 0 if corrupted, otherwise 1
+ */
+static inline int validate_checksum(struct pkt packet)
+{
+	return compute_checksum(packet.seqnum, packet.acknum, packet.payload) == packet.checksum;
+}
+
+#endif
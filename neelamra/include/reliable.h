@@ -0,0 +1,103 @@
+#ifndef RELIABLE_H_
+#define RELIABLE_H_
+
+/* libreliable: the simulator and the three protocols as a library ("make  */
+/* lib"). A simulation is a context made from a config; the protocol is    */
+/* picked by name when it is made. reliable_run() runs it in the calling   */
+/* thread on the context's simulator state, reset first, so runs start     */
+/* from the same state a fresh abt/gbn/sr does; different contexts may run */
+/* at once from any thread, and a run that fails verification returns its  */
+/* code instead of ending the caller. The library itself keeps no state.   */
+/* libreliable.so exports only the functions below; libreliable.a also    */
+/* carries the simulator's own names (init(), tolayer3(), ...), which a    */
+/* program linking it must not define.                                     */
+
+#define RELIABLE_QDISC_FIFO 0
+#define RELIABLE_QDISC_RED  1
+
+#define RELIABLE_CC_NONE  0
+#define RELIABLE_CC_AIMD  1
+#define RELIABLE_CC_CUBIC 2
+
+/* reliable_run() results below 0; above 0 it returns the exit code the */
+/* simulator verifies a run with (52 unexpected packet, 63 wrong data,  */
+/* 145 out of order, 59 over max_events, ...)                           */
+#define RELIABLE_EINVAL (-1)   /* the configuration cannot run */
+#define RELIABLE_ESYS   (-2)   /* the run could not be started */
+
+/* the command line options, as reliable_config_init() sets them unless noted */
+struct reliable_config {
+	const char *protocol;   /* "abt", "gbn" or "sr" */
+	int seed;               /* -s, 1 */
+	int window;             /* -w, 8 */
+	int messages;           /* -m, 1000 */
+	float loss;             /* -l, 0 */
+	float corruption;       /* -c, 0 */
+	float interarrival;     /* -t, 10 */
+	float bandwidth;        /* --bandwidth, 0 = legacy channel */
+	float delay;            /* --delay, 5 */
+	int queue;              /* --queue, 50 */
+	int qdisc;              /* --qdisc, RELIABLE_QDISC_FIFO */
+	float timeout;          /* --timeout, 0 = protocol default */
+	int cc;                 /* --cc, RELIABLE_CC_NONE */
+	float pace;             /* < 0 no pacing (default), 0 --pace, > 0 --pace-rate */
+	int fec_block;          /* --fec K:M, 0 = no FEC */
+	int fec_parity;
+	int harq;               /* --harq */
+	int nak;                /* --nak */
+	int msg_size;           /* --msg-size, 0 = one packet per message */
+	int mtu;                /* --mtu, 0 = the whole packet payload */
+	int wire;               /* --wire */
+	int rcvbuf;             /* --rcvbuf, 0 = none */
+	float drain;            /* --drain */
+	int sndbuf;             /* --sndbuf, 0 = no limit */
+	float warmup;           /* --warmup, 0 = none */
+	int complete;           /* --complete */
+	float complete_limit;   /* --complete=T, 0 = no limit */
+	long max_events;        /* events before the run is given up (59), 0 = no limit */
+};
+
+/* what the JSON summary reports */
+struct reliable_stats {
+	double time;            /* simulated time the run ended at */
+	long events;
+	int A_application;
+	int A_transport;
+	int B_transport;
+	int B_application;
+	int retransmissions;
+	int lost;
+	int corrupted;
+	int queue_drops;
+	int max_queue;
+	int naks;
+	float latency_p50;
+	float latency_p90;
+	float latency_p99;
+	float latency_p99_9;
+	float latency_max;
+	double throughput;      /* A_transport per time unit */
+	double goodput;         /* B_application per time unit */
+	long bytes_delivered;
+	double steady_goodput;  /* over the steady state, or goodput without a warm-up */
+	float steady_latency_p50;
+	float steady_latency_p99;
+	double completion_time; /* time the last message was delivered, -1 if it was not */
+};
+
+/* what libreliable.so exports, everything else being built hidden */
+#if defined(__GNUC__)
+#define RELIABLE_API __attribute__((visibility("default")))
+#else
+#define RELIABLE_API
+#endif
+
+struct reliable_sim;
+
+RELIABLE_API void reliable_config_init(struct reliable_config *cfg);
+RELIABLE_API struct reliable_sim *reliable_create(const struct reliable_config *cfg);
+RELIABLE_API int reliable_run(struct reliable_sim *sim);
+RELIABLE_API const struct reliable_stats *reliable_stats(const struct reliable_sim *sim);
+RELIABLE_API void reliable_destroy(struct reliable_sim *sim);
+
+#endif
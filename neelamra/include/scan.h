@@ -0,0 +1,28 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stdint.h>
+
+/* Window scans over the sender ring: send times in a double array and ACKed */
+/* flags in a ring bitset (see proto.h), both indexed by ring_slot(seqnum). */
+/* The kernels use AVX2 or SSE2 when the build targets them (BUILD=release  */
+/* uses -march=native) and plain C otherwise, or when built with            */
+/* -DSCAN_SCALAR; SCAN_ISA names the choice. The *_scalar versions are      */
+/* always built, as the reference for the bench and for "make check".       */
+double scan_oldest(const double *start_time, const uint64_t *acked, int from, int to, double oldest);
+int scan_next_unacked(const uint64_t *acked, int from, int to);
+int scan_first_expired(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit);
+int scan_expired(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit, uint64_t *expired);
+
+double scan_oldest_scalar(const double *start_time, const uint64_t *acked, int from, int to, double oldest);
+int scan_next_unacked_scalar(const uint64_t *acked, int from, int to);
+int scan_first_expired_scalar(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit);
+int scan_expired_scalar(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit, uint64_t *expired);
+
+extern const char *const SCAN_ISA;
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SEG_H_
+#define SEG_H_
+
+#include "simulator.h"
+
+/* Segmentation of application messages of up to SEG_MAXMSG bytes into  */
+/* msgs for the transport. Each segment starts with a SEG_HDR_LEN byte   */
+/* header: the number of data bytes in it, with SEG_LAST set on the last */
+/* segment of a message. The transport must deliver in order.           */
+#define SEG_MAXMSG  65536
+#define SEG_HDR_LEN 2
+#define SEG_LAST    0x8000
+
+struct seg_state {
+	int mtu;                    /* payload bytes used per packet, header included */
+	char rxbuf[SEG_MAXMSG];     /* message being reassembled */
+	int rxlen;
+};
+
+void seg_init(struct sim_state *sim, int mtu);
+int seg_count(struct sim_state *sim, int len);
+void seg_output(struct sim_state *sim, const char *data, int len, void (*output)(struct sim_state *sim, struct msg));
+const char *seg_input(struct sim_state *sim, const char *data, int *len);
+
+#endif
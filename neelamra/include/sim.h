@@ -0,0 +1,261 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/types.h>
+
+#include "simulator.h"
+#include "hdr.h"
+#include "wire.h"
+#include "cc.h"
+#include "timers.h"
+#include "pacer.h"
+#include "fec.h"
+#include "flow.h"
+#include "nak.h"
+#include "seg.h"
+
+/* The state of one simulation: what used to be the simulator's globals, */
+/* the state of the helper modules the protocols use and, at arq, the    */
+/* protocol's own. Everything a run touches is in here, so simulations   */
+/* in the same process do not share anything.                            */
+
+/* msg_track: a ring of the messages given to A and not yet delivered at B */
+#define MSG_TRACK_SIZE 65536
+struct msg_track {
+	char letter;            /* every byte of the message */
+	int delivered;
+	double sent_time;       /* time the message was given to A_output() */
+};
+
+/* sender queueing delay, from A_output() to a packet's first transmission */
+#define SNDQ_SIZE 65536
+
+/* random number generator, kept in our own state so snapshots can carry it */
+#define RNG_STATE_SIZE 128
+
+/* snapshots: regions registered with register_state(), saved and restored as is */
+#define MAX_STATE_REGIONS 128
+struct state_region {
+	void *ptr;
+	size_t size;
+};
+
+/* parameter reload hooks, called when a what-if branch changes the parameters */
+#define MAX_RELOAD_HOOKS 8
+
+/* queueing disciplines of the bottleneck link */
+#define QDISC_FIFO 0
+#define QDISC_RED  1
+
+/* what-if branches: forked at --branch-at, one per --variant */
+#define MAX_VARIANTS 64
+struct variant {
+	char *spec;             /* as given to --variant */
+	int win_size;           /* < 0 = unchanged */
+	float timeout;
+	float lossprob;
+	float corruptprob;
+	pid_t pid;
+	int fd;                 /* read end of the pipe the result comes back on */
+};
+
+struct event;
+
+struct sim_state {
+	const struct sim_protocol *protocol;
+	void *arq;                 /* the protocol's state, protocol->size bytes */
+	jmp_buf *bail;             /* where sim_exit() returns to, NULL = exit() */
+	int exit_code;             /* the code sim_exit() was given */
+
+	/* Statistics */
+	int A_application;
+	int A_transport;
+	int B_application;
+	int B_transport;
+
+	int win_size;
+	int cc_algo;
+	float pace_rate;           /* < 0 no pacing, 0 window/SRTT, > 0 fixed rate */
+	int fec_block;             /* data packets per FEC block, 0 = no FEC */
+	int fec_parity;            /* parity packets per FEC block */
+	int harq;                  /* adapt the FEC parity to the observed loss (sr) */
+	int use_nak;               /* B reports the holes it sees in NAKs (gbn, sr) */
+	float timeout;             /* retransmission timeout, 0 = protocol default */
+
+	struct event *evlist;      /* the event list */
+	struct event *cur_event;   /* the event being handled, off the list until it is freed */
+
+	struct msg_track application_msgs[MSG_TRACK_SIZE];
+	int cur_msg_sent, cur_msg_recv;
+	long bytes_delivered;
+
+	/* application messages of msg_size bytes, segmented to mtu-byte payloads; 0 = one msg each */
+	int msg_size;
+	int mtu;
+	char msgbuf[SEG_MAXMSG];
+
+	/* packets put into layer 3 as struct pkt and, with --wire, in the compact wire format */
+	int wire;
+	struct wire_ctx wire_tx[2], wire_rx[2];
+	long raw_bytes, wire_bytes;
+
+	/* B's receive buffer, which its application reads drain_rate messages per time unit from */
+	int rcvbuf;                /* packets the buffer holds, 0 = the application reads at once */
+	float drain_rate;
+	int rcv_queued;            /* packets waiting for the application */
+	double rcv_read;           /* time the application has read up to */
+	int rcv_maxqueued;
+	int nprobes;               /* zero-window probes sent by A */
+	int nnaks;                 /* NAKs sent by B */
+
+	/* A's send buffer: with --sndbuf, layer 5 stops generating messages while it is full */
+	int sndbuf;                /* packets A may buffer, 0 = no limit */
+	int backlog;               /* packets buffered at A, as reported */
+	int l5_blocked;            /* whether layer 5 is waiting for room */
+	double l5_blocked_at;
+	double l5_blocked_time;
+	int nblocked;
+
+	/* measurement window, see --warmup and --complete */
+	float warmup;
+	int complete;
+	float complete_limit;      /* time --complete may go on past the last message, 0 = no limit */
+	int ss_B_start;            /* B_application at the end of the warm-up, -1 = not reached yet */
+	int ss_B_end;              /* B_application when layer 5 gave its last message */
+	double ss_end;             /* time layer 5 gave its last message */
+	double done_at;            /* time B delivered the last message, -1 = not yet */
+	struct hdr_hist ss_latency;  /* latency of the messages given to A after the warm-up */
+
+	double sndq_time[SNDQ_SIZE];
+	int sndq_in, sndq_out;
+	struct hdr_hist sndq_latency;
+
+	/* per-message latency, from A_output() to tolayer5(), in 1/LAT_SCALE time units */
+	struct hdr_hist latency;
+	struct hdr_hist sample_latency;  /* latencies since the last --samples row */
+	int sample_A_transport;
+	int sample_B_application;
+
+	int TRACE;                 /* for my debugging, < 0 = not even the panics */
+	int nsim;                  /* number of messages from 5 to 4 so far */
+	int nsimmax;               /* number of msgs to generate, then stop */
+	int64_t sim_ticks;         /* the clock events are scheduled on */
+	double time;               /* sim_ticks in time units */
+	float lossprob;            /* probability that a packet is dropped */
+	float corruptprob;         /* probability that one bit is packet is flipped */
+	float lambda;              /* arrival rate of messages from layer 5 */
+	int ntolayer3;             /* number sent into layer 3 */
+	int nlost;                 /* number lost in media */
+	int ncorrupt;              /* number corrupted by media*/
+	long nevents;              /* number of events simulated */
+	long max_events;           /* events before a run is given up, 0 = no limit, -1 = the default */
+	int nretrans;              /* retransmissions reported by the protocols */
+	int winocc[2];             /* packets outstanding in A's/B's window, as reported */
+	int inchannel[2];          /* packets in the media on their way to A/B */
+
+	/* machine-readable output */
+	char *progname;
+	char *json_file;           /* summary as JSON */
+	char *csv_file;            /* summary as a CSV header and row */
+	char *samples_file;        /* time series, one CSV row per sample */
+	float sample_interval;
+	double next_sample;
+	FILE *samples_fp;
+	int seed;
+
+	struct random_data rng;
+	char rng_state[RNG_STATE_SIZE];
+
+	struct state_region state_regions[MAX_STATE_REGIONS];
+	int nstate_regions;
+	char *snapshot_file;
+	float snapshot_at;
+	char *restore_file;
+
+	void (*reload_hooks[MAX_RELOAD_HOOKS])(struct sim_state *sim);
+	int nreload_hooks;
+
+	struct variant variants[MAX_VARIANTS];
+	int nvariants;
+	float branch_at;
+	int branch_fd;             /* in a branch: write end of its result pipe */
+
+	/* Monte Carlo: the same configuration over --seeds seeds, --jobs at a time */
+	int nseeds;
+	int njobs;                 /* 0 = one per online CPU */
+	float ci_width;            /* relative 95% CI width to stop at, 0 = run all seeds */
+
+	/* tuner: successive halving over window and timeout */
+	int ntune;                 /* configurations to start from, 0 = no tuning */
+	int tune_win[2];
+	float tune_timeout[2];
+
+	/* bottleneck link model (disabled while bandwidth is 0) */
+	float bandwidth;           /* packets per time unit serialized onto the link */
+	float propdelay;           /* one way propagation delay of the link */
+	int qlimit;                /* bottleneck queue capacity in packets */
+	int qdisc;                 /* queueing discipline of the bottleneck */
+	double link_busy[2];       /* time the link out of A/B goes idle */
+	float red_avg[2];          /* RED average queue length per direction */
+	int nqdrop;                /* number dropped at the bottleneck queue */
+	int maxqdepth;             /* deepest queue seen at the bottleneck */
+
+	/* the helper modules of the windowed protocols */
+	struct cc_state cc;
+	struct lt_state lt;
+	struct pacer_state pacer;
+	struct fec_state fec;
+	struct flow_state flow;
+	struct nak_state nak;
+	struct seg_state seg;
+};
+
+/**
+ * function for making the state of a simulation of protocol p
+ *
+ * The protocol's state follows the simulator's in the same block, so
+ * the offsets the pacer keeps between them hold in any process.
+ *
+ * @param p Protocol to simulate
+ * @return The state, all zero, or NULL if there is no memory; free() it
+ */
+static inline struct sim_state *sim_alloc(const struct sim_protocol *p)
+{
+	struct sim_state *sim = (struct sim_state *)calloc(1, sizeof(struct sim_state) + p->size);
+
+	if (sim == NULL)
+		return NULL;
+	sim->protocol = p;
+	sim->arq = sim + 1;
+	return sim;
+}
+
+/**
+ * function for making a simulation's state all zero again, as
+ * sim_alloc() gave it, so it can be run once more
+ *
+ * @param sim State to reset, whose event list has been cleared
+ */
+static inline void sim_reset(struct sim_state *sim)
+{
+	const struct sim_protocol *p = sim->protocol;
+
+	memset(sim, 0, sizeof(struct sim_state) + p->size);
+	sim->protocol = p;
+	sim->arq = sim + 1;
+}
+
+/* the simulator's own routines on a simulation, for the drivers of simulator.c */
+void sim_defaults(struct sim_state *sim);
+int sim_main(struct sim_state *sim, int argc, char **argv);
+int sim_run(struct sim_state *sim);
+void clear_events(struct sim_state *sim);
+float latency_at(struct hdr_hist *h, double percentile);
+double measured_goodput(struct sim_state *sim);
+struct hdr_hist *measured_latency(struct sim_state *sim);
+
+#endif
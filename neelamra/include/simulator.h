@@ -1,13 +1,24 @@
 #ifndef SIMULATOR_H_
 #define SIMULATOR_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define BIDIRECTIONAL 0
 
+/* the simulator clock is a 64-bit count of SIM_TICKS ticks per time unit */
+#define SIM_TICKS 1000000
+
+/* bytes of data in a msg and a packet; "make MTU=n" builds n-byte packets */
+#ifndef PAYLOAD_LEN
+#define PAYLOAD_LEN 20
+#endif
+
 /* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
 /* 4 (students' code).  It contains the data (characters) to be delivered */
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
-  char data[20];
+  char data[PAYLOAD_LEN];
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
@@ -17,24 +28,64 @@ struct pkt {
    int seqnum;
    int acknum;
    int checksum;
-   char payload[20];
+   char payload[PAYLOAD_LEN];
 };
 
-/* Implementation framework interface */
-void A_output(struct msg message);
-void A_input(struct pkt packet);
-void A_timerinterrupt();
-void A_init();
+/* Every routine below is given the simulation it belongs to, whose state  */
+/* (sim.h) holds the simulator's, its modules' and, at sim->arq, the        */
+/* protocol's own, so any number of simulations can run side by side.      */
+struct sim_state;
+
+/* Implementation framework interface: a protocol is its routines and the  */
+/* bytes of state they keep at sim->arq, which start out zeroed            */
+struct sim_protocol {
+	size_t size;
+	void (*A_output)(struct sim_state *sim, struct msg message);
+	void (*A_input)(struct sim_state *sim, struct pkt packet);
+	void (*A_timerinterrupt)(struct sim_state *sim);
+	void (*A_init)(struct sim_state *sim);
+	void (*B_input)(struct sim_state *sim, struct pkt packet);
+	void (*B_timerinterrupt)(struct sim_state *sim);
+	void (*B_init)(struct sim_state *sim);
+};
 
-void B_input(struct pkt packet);
-void B_init();
+/* the protocol an abt/gbn/sr (or bench_*, shm_*) binary is linked with */
+extern const struct sim_protocol *const sim_protocol;
 
 /* Simulator API */
-void starttimer(int AorB, float increment);
-void stoptimer(int AorB);
-void tolayer3(int AorB, struct pkt packet);
-void tolayer5(int AorB, char datasent[]);
-int getwinsize();
-float get_sim_time();
-
-#endif
\ No newline at end of file
+void starttimer(struct sim_state *sim, int AorB, float increment);
+void stoptimer(struct sim_state *sim, int AorB);
+void tolayer3(struct sim_state *sim, int AorB, struct pkt packet);
+void tolayer5(struct sim_state *sim, int AorB, char datasent[]);
+int getwinsize(struct sim_state *sim);
+int getccmode(struct sim_state *sim);
+float getpacerate(struct sim_state *sim);
+int getfeck(struct sim_state *sim);
+int getfecm(struct sim_state *sim);
+int getharq(struct sim_state *sim);
+int getnak(struct sim_state *sim);
+float gettimeout(struct sim_state *sim);
+int getrcvbuf(struct sim_state *sim);
+int getrcvfree(struct sim_state *sim);
+double get_sim_time(struct sim_state *sim);
+int64_t get_sim_ticks(struct sim_state *sim);
+
+/* Ends the run with an exit code, as a failed check in the simulator does */
+void sim_exit(struct sim_state *sim, int code);
+
+/* Snapshots: state registered here is saved and restored with the simulator's */
+void register_state(struct sim_state *sim, void *ptr, size_t size);
+#define SAVE_STATE(sim, var) register_state(sim, &(var), sizeof(var))
+
+/* What-if branches: hooks re-reading the get*() parameters when a branch changes them */
+void register_reload(struct sim_state *sim, void (*fn)(struct sim_state *sim));
+
+/* Instrumentation, reported in the --json/--csv/--samples output */
+void report_window(struct sim_state *sim, int AorB, int inflight);
+void report_retransmit(struct sim_state *sim, int AorB);
+void report_probe(struct sim_state *sim, int AorB);
+void report_nak(struct sim_state *sim, int AorB);
+void report_send(struct sim_state *sim, int AorB);
+void report_backlog(struct sim_state *sim, int AorB, int queued);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SPSC_H_
+#define SPSC_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "simulator.h"
+
+/* Lock-free single-producer/single-consumer ring of packets, meant to   */
+/* live in memory shared between two processes. The producer only       */
+/* writes head and the consumer only writes tail, each on its own cache  */
+/* line; each end also keeps a private copy of the other's index so it   */
+/* only touches the shared line when the ring looks full or empty. Each  */
+/* packet carries a stamp from the producer, e.g. the time it was sent.  */
+#define SPSC_SLOTS 4096      /* a power of two */
+#define SPSC_LINE  64
+
+struct spsc_slot {
+	struct pkt packet;
+	int64_t stamp;
+};
+
+struct spsc_ring {
+	_Alignas(SPSC_LINE) _Atomic uint32_t head;   /* next slot to fill */
+	_Alignas(SPSC_LINE) _Atomic uint32_t tail;   /* next slot to empty */
+	_Alignas(SPSC_LINE) struct spsc_slot slots[SPSC_SLOTS];
+};
+
+/* one end of a ring, private to the process using it */
+struct spsc_end {
+	struct spsc_ring *ring;
+	uint32_t pos;      /* own index */
+	uint32_t other;    /* last value seen of the other end's index */
+};
+
+static inline void spsc_init(struct spsc_ring *ring)
+{
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+}
+
+static inline void spsc_attach(struct spsc_end *end, struct spsc_ring *ring)
+{
+	end->ring = ring;
+	end->pos = end->other = 0;
+}
+
+/* producer: returns 0 if the ring is full */
+static inline int spsc_push(struct spsc_end *end, const struct pkt *packet, int64_t stamp)
+{
+	struct spsc_slot *slot;
+	if (end->pos - end->other == SPSC_SLOTS){
+		end->other = atomic_load_explicit(&end->ring->tail, memory_order_acquire);
+		if (end->pos - end->other == SPSC_SLOTS){
+			return 0;
+		}
+	}
+	slot = &end->ring->slots[end->pos & (SPSC_SLOTS - 1)];
+	slot->packet = *packet;
+	slot->stamp = stamp;
+	atomic_store_explicit(&end->ring->head, ++end->pos, memory_order_release);
+	return 1;
+}
+
+/* consumer: returns 0 if the ring is empty */
+static inline int spsc_pop(struct spsc_end *end, struct pkt *packet, int64_t *stamp)
+{
+	struct spsc_slot *slot;
+	if (end->pos == end->other){
+		end->other = atomic_load_explicit(&end->ring->head, memory_order_acquire);
+		if (end->pos == end->other){
+			return 0;
+		}
+	}
+	slot = &end->ring->slots[end->pos & (SPSC_SLOTS - 1)];
+	*packet = slot->packet;
+	*stamp = slot->stamp;
+	atomic_store_explicit(&end->ring->tail, ++end->pos, memory_order_release);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef TIMERS_H_
+#define TIMERS_H_
+
+/* logical timers of entity A, multiplexed onto the simulator timer */
+#define TIMER_RTX     0    /* retransmission timeout */
+#define TIMER_PACE    1    /* pacer release */
+#define TIMER_PERSIST 2    /* zero-window probe */
+#define NTIMERS       4
+
+#include "simulator.h"
+
+struct lt_state {
+	double deadline[NTIMERS];
+	int active[NTIMERS];
+	double armed;        /* deadline the simulator timer is set for */
+	int armed_on;        /* whether the simulator timer is running */
+};
+
+void lt_init(struct sim_state *sim);
+void lt_start(struct sim_state *sim, int id, float increment);
+void lt_stop(struct sim_state *sim, int id);
+int lt_running(struct sim_state *sim, int id);
+void lt_interrupt(struct sim_state *sim);
+int lt_expire(struct sim_state *sim);
+
+#endif
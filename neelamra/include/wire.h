@@ -0,0 +1,28 @@
+#ifndef WIRE_H_
+#define WIRE_H_
+
+#include <stdint.h>
+
+#include "simulator.h"
+
+/* Compact byte encoding of a struct pkt, for backends that carry bytes.  */
+/* A packet is a flags byte, the sequence and ACK numbers as zigzag       */
+/* varints of their change since the previous packet of the stream, the   */
+/* low 16 bits of the checksum, then the payload unless WIRE_ACK is set.  */
+/* Encodings are self-delimiting, so packets can be written back to back; */
+/* the stream must arrive in order and complete, as each packet is coded  */
+/* against the one before it.                                             */
+#define WIRE_ACK    0x01     /* no payload on the wire; it decodes as zeros */
+#define WIRE_MAXLEN (1 + 5 + 5 + 2 + PAYLOAD_LEN)
+
+/* one direction of a stream; the encoder and decoder each keep one */
+struct wire_ctx {
+	int seqnum;
+	int acknum;
+};
+
+void wire_init(struct wire_ctx *ctx);
+int wire_encode(struct wire_ctx *ctx, const struct pkt *packet, int flags, uint8_t *buf);
+int wire_decode(struct wire_ctx *ctx, const uint8_t *buf, int len, struct pkt *packet);
+
+#endif
@@ -0,0 +1,132 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/cc.h"
+
+/* ******************************************************************
+   Congestion control for the windowed senders.
+
+   - slow start: cwnd grows by one packet per ACKed packet until it
+   reaches ssthresh
+   - AIMD: above ssthresh cwnd grows by one packet per window, and a
+   loss halves it
+   - CUBIC: above ssthresh cwnd follows W(t) = C(t - K)^3 + Wmax from
+   the time of the last loss, and a loss cuts it to BETA * cwnd
+
+   The only loss signal the senders have is a retransmission timeout.
+   Timeouts of packets sent before the last reduction belong to the
+   same loss event and do not shrink the window again.
+ **********************************************************************/
+
+#include<math.h>
+
+#define INIT_CWND 1.0
+#define MIN_CWND 1.0
+#define AIMD_BETA 0.5
+#define CUBIC_BETA 0.7
+#define CUBIC_C 0.01
+
+/* sets the initial congestion window for the given algorithm */
+void cc_init(struct sim_state *sim, int mode, int maxwin)
+{
+	struct cc_state *cc = &sim->cc;
+
+	cc->mode = mode;
+	cc->maxwin = maxwin;
+	cc->congwin = (mode == CC_NONE) ? maxwin : INIT_CWND;
+	cc->ssthresh = maxwin;
+	cc->wmax = 0.0;
+	cc->epoch = 0.0;
+	cc->K = 0.0;
+	cc->last_loss = -1.0;
+	SAVE_STATE(sim, cc->congwin);
+	SAVE_STATE(sim, cc->ssthresh);
+	SAVE_STATE(sim, cc->wmax);
+	SAVE_STATE(sim, cc->epoch);
+	SAVE_STATE(sim, cc->K);
+	SAVE_STATE(sim, cc->last_loss);
+}
+
+/* changes the maximum window, e.g. in a what-if branch */
+void cc_set_maxwin(struct sim_state *sim, int maxwin)
+{
+	struct cc_state *cc = &sim->cc;
+
+	cc->maxwin = maxwin;
+	if (cc->mode == CC_NONE || cc->congwin > cc->maxwin){
+		cc->congwin = maxwin;
+	}
+}
+
+/* called with the number of packets newly acknowledged by an ACK */
+void cc_on_ack(struct sim_state *sim, int nacked)
+{
+	struct cc_state *cc = &sim->cc;
+	int i;
+	float t, target;
+
+	if (cc->mode == CC_NONE){
+		return;
+	}
+	for (i = 0; i < nacked; i++){
+		if (cc->congwin < cc->ssthresh){
+			/* slow start */
+			cc->congwin += 1.0;
+		}
+		else if (cc->mode == CC_CUBIC){
+			t = get_sim_time(sim) - cc->epoch;
+			target = CUBIC_C * (t - cc->K) * (t - cc->K) * (t - cc->K) + cc->wmax;
+			if (target > cc->congwin){
+				cc->congwin += (target - cc->congwin) / cc->congwin;
+			}
+			else {
+				cc->congwin += 0.01 / cc->congwin;
+			}
+		}
+		else {
+			/* additive increase */
+			cc->congwin += 1.0 / cc->congwin;
+		}
+	}
+	/* growing past the maximum window cannot be used and makes losses slower to react */
+	if (cc->congwin > cc->maxwin){
+		cc->congwin = cc->maxwin;
+	}
+}
+
+/* called when the packet first sent at sent_time timed out */
+void cc_on_loss(struct sim_state *sim, double sent_time)
+{
+	struct cc_state *cc = &sim->cc;
+
+	if (cc->mode == CC_NONE || sent_time < cc->last_loss){
+		return;
+	}
+	cc->last_loss = get_sim_time(sim);
+	if (cc->mode == CC_CUBIC){
+		cc->wmax = cc->congwin;
+		cc->congwin *= CUBIC_BETA;
+		cc->epoch = cc->last_loss;
+		cc->K = cbrtf(cc->wmax * (1 - CUBIC_BETA) / CUBIC_C);
+	}
+	else {
+		cc->congwin *= AIMD_BETA;
+	}
+	if (cc->congwin < MIN_CWND){
+		cc->congwin = MIN_CWND;
+	}
+	cc->ssthresh = cc->congwin;
+}
+
+/* returns the number of packets the sender may have outstanding */
+int cc_window(struct sim_state *sim)
+{
+	struct cc_state *cc = &sim->cc;
+	int cwnd = (int)cc->congwin;
+	return cwnd < cc->maxwin ? cwnd : cc->maxwin;
+}
+
+/* returns the congestion window before rounding, for reporting */
+float cc_cwnd(struct sim_state *sim)
+{
+	return sim->cc.congwin;
+}
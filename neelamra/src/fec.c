@@ -0,0 +1,315 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/proto.h"
+#include "../include/fec.h"
+#include "../include/pacer.h"
+
+/* ******************************************************************
+   Forward error correction for the windowed protocols.
+
+   The sender groups data packets by sequence number into blocks of k
+   (block = seqnum / k) and, after the first transmission of the last
+   packet of a block, sends m parity packets over the k payloads:
+   - m = 1: the XOR of the payloads
+   - m > 1: a systematic Reed-Solomon code over GF(256) built from a
+   Cauchy matrix, so any k of the k + m packets rebuild the block
+
+   The receiver keeps the payloads of recent blocks and, once at most
+   as many packets are missing as parity packets have arrived, rebuilds
+   the missing ones and passes the block, from the first hole onwards,
+   to the protocol in sequence order. Retransmissions are not covered.
+ **********************************************************************/
+
+#include<string.h>
+
+#define TRUE 1
+#define FALSE 0
+#define MSG_LEN PAYLOAD_LEN
+#define GF_POLY 0x11d
+
+unsigned char gf_mul(struct fec_state *fec, unsigned char a, unsigned char b)
+{
+	if (a == 0 || b == 0){
+		return 0;
+	}
+	return fec->gf_exp[fec->gf_log[a] + fec->gf_log[b]];
+}
+
+unsigned char gf_inv(struct fec_state *fec, unsigned char a)
+{
+	return fec->gf_exp[255 - fec->gf_log[a]];
+}
+
+/* dst ^= c * src over a payload */
+void gf_addmul(struct fec_state *fec, char *dst, const char *src, unsigned char c)
+{
+	int i;
+	if (c == 0){
+		return;
+	}
+	if (c == 1){
+		for (i = 0; i < MSG_LEN; i++){
+			dst[i] ^= src[i];
+		}
+		return;
+	}
+	for (i = 0; i < MSG_LEN; i++){
+		dst[i] ^= gf_mul(fec, c, (unsigned char)src[i]);
+	}
+}
+
+/* coefficient of data packet i in parity packet j of a block with m parity packets */
+unsigned char fec_coef(struct fec_state *fec, int m, int j, int i)
+{
+	if (m == 1){
+		return 1;
+	}
+	return gf_inv(fec, (unsigned char)((fec->k + j) ^ i));
+}
+
+int fec_parity_ack(int j, int m)
+{
+	return -1 - (j + FEC_MAXM * m);
+}
+
+void fec_init(struct sim_state *sim, int k, int m)
+{
+	struct fec_state *fec = &sim->fec;
+	int i, x = 1;
+
+	fec->k = k < FEC_MAXK ? k : FEC_MAXK;
+	fec->m = m < FEC_MAXM ? m : FEC_MAXM;
+	fec->nrecovered = 0;
+	for (i = 0; i < 255; i++){
+		fec->gf_exp[i] = fec->gf_exp[i + 255] = x;
+		fec->gf_log[x] = i;
+		x <<= 1;
+		if (x & 0x100){
+			x ^= GF_POLY;
+		}
+	}
+	for (i = 0; i < FEC_NBLOCKS; i++){
+		fec->rx[i].block = -1;
+	}
+	SAVE_STATE(sim, fec->m);
+	SAVE_STATE(sim, fec->nrecovered);
+	SAVE_STATE(sim, fec->txdata);
+	SAVE_STATE(sim, fec->txparity);
+	SAVE_STATE(sim, fec->txtime);
+	SAVE_STATE(sim, fec->rx);
+}
+
+/* changes the number of parity packets sent for blocks not yet complete */
+void fec_set_parity(struct sim_state *sim, int m)
+{
+	sim->fec.m = m < FEC_MAXM ? m : FEC_MAXM;
+}
+
+/**
+ * function for adding a data packet to the current block, called after
+ * its first transmission; sends the parity packets once the block is full
+ *
+ * @param packet Data packet just sent
+ */
+void fec_output(struct sim_state *sim, struct pkt *packet)
+{
+	struct fec_state *fec = &sim->fec;
+	int i, j, block, idx, slot;
+	struct pkt *parity;
+
+	if (fec->k == 0){
+		return;
+	}
+	block = packet->seqnum / fec->k;
+	idx = packet->seqnum % fec->k;
+	memcpy(fec->txdata[idx], packet->payload, MSG_LEN);
+	if (idx != fec->k - 1 || fec->m == 0){
+		return;
+	}
+
+	slot = block % FEC_NBLOCKS;
+	for (j = 0; j < fec->m; j++){
+		parity = &fec->txparity[slot][j];
+		memset(parity->payload, 0, MSG_LEN);
+		for (i = 0; i < fec->k; i++){
+			gf_addmul(fec, parity->payload, fec->txdata[i], fec_coef(fec, fec->m, j, i));
+		}
+		parity->seqnum = block;
+		parity->acknum = fec_parity_ack(j, fec->m);
+		parity->checksum = compute_checksum(parity->seqnum, parity->acknum, parity->payload);
+		pacer_send(sim, parity, &fec->txtime[slot][j]);
+	}
+}
+
+/* solves for the missing payloads of a block; returns FALSE if not enough parity has arrived */
+int fec_decode(struct fec_state *fec, struct fec_rxblock *b, int m)
+{
+	int missing[FEC_MAXM];
+	unsigned char mat[FEC_MAXM][FEC_MAXM];
+	char rhs[FEC_MAXM][MSG_LEN];
+	int i, r, c, nmissing = 0;
+	unsigned char f;
+
+	for (i = 0; i < fec->k; i++){
+		if (!b->present[i]){
+			if (nmissing == FEC_MAXM){
+				return FALSE;
+			}
+			missing[nmissing++] = i;
+		}
+	}
+	if (nmissing > b->nparity){
+		return FALSE;
+	}
+
+	/* syndromes: parity minus the contribution of the packets we have */
+	for (r = 0; r < nmissing; r++){
+		memcpy(rhs[r], b->parity[r], MSG_LEN);
+		for (i = 0; i < fec->k; i++){
+			if (b->present[i]){
+				gf_addmul(fec, rhs[r], b->data[i], fec_coef(fec, m, b->parity_idx[r], i));
+			}
+		}
+		for (c = 0; c < nmissing; c++){
+			mat[r][c] = fec_coef(fec, m, b->parity_idx[r], missing[c]);
+		}
+	}
+
+	/* Gauss-Jordan elimination; every square Cauchy submatrix is invertible */
+	for (c = 0; c < nmissing; c++){
+		for (r = c; r < nmissing && mat[r][c] == 0; r++);
+		if (r == nmissing){
+			return FALSE;
+		}
+		if (r != c){
+			unsigned char tmprow[FEC_MAXM];
+			char tmp[MSG_LEN];
+			memcpy(tmprow, mat[r], sizeof(tmprow));
+			memcpy(mat[r], mat[c], sizeof(tmprow));
+			memcpy(mat[c], tmprow, sizeof(tmprow));
+			memcpy(tmp, rhs[r], MSG_LEN);
+			memcpy(rhs[r], rhs[c], MSG_LEN);
+			memcpy(rhs[c], tmp, MSG_LEN);
+		}
+		f = gf_inv(fec, mat[c][c]);
+		for (i = 0; i < nmissing; i++){
+			mat[c][i] = gf_mul(fec, mat[c][i], f);
+		}
+		for (i = 0; i < MSG_LEN; i++){
+			rhs[c][i] = gf_mul(fec, (unsigned char)rhs[c][i], f);
+		}
+		for (r = 0; r < nmissing; r++){
+			if (r != c && mat[r][c] != 0){
+				f = mat[r][c];
+				for (i = 0; i < nmissing; i++){
+					mat[r][i] ^= gf_mul(fec, mat[c][i], f);
+				}
+				gf_addmul(fec, rhs[r], rhs[c], f);
+			}
+		}
+	}
+
+	for (r = 0; r < nmissing; r++){
+		memcpy(b->data[missing[r]], rhs[r], MSG_LEN);
+		b->present[missing[r]] = TRUE;
+	}
+	fec->nrecovered += nmissing;
+	return TRUE;
+}
+
+/**
+ * function for passing a received packet through the FEC layer
+ *
+ * @param packet Received packet
+ * @param deliver Protocol input routine for rebuilt packets
+ * @return 1 if the FEC layer consumed the packet, 0 if the protocol should process it
+ */
+int fec_input(struct sim_state *sim, struct pkt packet, void (*deliver)(struct sim_state *sim, struct pkt))
+{
+	struct fec_state *fec = &sim->fec;
+	int i, m, first, block, idx, is_parity;
+	struct fec_rxblock *b;
+	struct pkt rebuilt;
+
+	if (fec->k == 0 || !validate_checksum(packet)){
+		return FALSE;
+	}
+	is_parity = packet.acknum < 0;
+	if (is_parity){
+		block = packet.seqnum;
+		m = (-1 - packet.acknum) / FEC_MAXM;
+		idx = (-1 - packet.acknum) % FEC_MAXM;
+	}
+	else {
+		block = packet.seqnum / fec->k;
+		m = 0;
+		idx = packet.seqnum % fec->k;
+	}
+
+	b = &fec->rx[block % FEC_NBLOCKS];
+	if (b->block != block){
+		if (b->block > block){
+			/* too old to keep state for */
+			return is_parity;
+		}
+		b->block = block;
+		b->done = FALSE;
+		b->nparity = 0;
+		for (i = 0; i < fec->k; i++){
+			b->present[i] = FALSE;
+		}
+	}
+	if (b->done){
+		return is_parity;
+	}
+
+	if (is_parity){
+		if (b->nparity == FEC_MAXM || m < 1 || m > FEC_MAXM){
+			return TRUE;
+		}
+		b->m = m;
+		b->parity_idx[b->nparity] = idx;
+		memcpy(b->parity[b->nparity], packet.payload, MSG_LEN);
+		b->nparity++;
+	}
+	else {
+		if (b->present[idx]){
+			return FALSE;
+		}
+		b->present[idx] = TRUE;
+		memcpy(b->data[idx], packet.payload, MSG_LEN);
+	}
+	if (b->nparity == 0){
+		return is_parity;
+	}
+
+	/* rebuilding the missing packets once enough parity has arrived */
+	for (first = 0; first < fec->k && b->present[first]; first++);
+	if (first == fec->k){
+		b->done = TRUE;
+		return is_parity;
+	}
+	if (!fec_decode(fec, b, b->m)){
+		return is_parity;
+	}
+	b->done = TRUE;
+
+	/* handing the block to the protocol in order, from the first hole (or this packet) on */
+	if (!is_parity && idx < first){
+		first = idx;
+	}
+	for (i = first; i < fec->k; i++){
+		rebuilt.seqnum = block * fec->k + i;
+		rebuilt.acknum = 1;
+		memcpy(rebuilt.payload, b->data[i], MSG_LEN);
+		rebuilt.checksum = compute_checksum(rebuilt.seqnum, rebuilt.acknum, rebuilt.payload);
+		deliver(sim, rebuilt);
+	}
+	return TRUE;
+}
+
+/* returns the number of data packets rebuilt from parity so far */
+int fec_recovered(struct sim_state *sim)
+{
+	return sim->fec.nrecovered;
+}
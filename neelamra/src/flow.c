@@ -0,0 +1,121 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/flow.h"
+#include "../include/timers.h"
+
+/* ******************************************************************
+   Receiver-advertised window for the windowed senders.
+
+   B advertises in every ACK how far the sender may go: the next
+   sequence number it expects plus the free space in its receive
+   buffer, which B's application drains at its own pace. The sender
+   sends up to min(congestion window, advertised edge). Once the edge
+   stops it with nothing in flight, no ACK will come to move the edge
+   again, so the TIMER_PERSIST logical timer probes B with the next
+   packet, backing off while the window stays closed. B takes the
+   probe if it has room, and answers it either way.
+ **********************************************************************/
+
+#include<limits.h>
+
+#define A 0
+#define TRUE 1
+#define FALSE 0
+#define PERSIST_MAX 8      /* longest probe interval, in retransmission timeouts */
+
+void flow_init(struct sim_state *sim, float rto)
+{
+	struct flow_state *flow = &sim->flow;
+
+	flow->on = getrcvbuf(sim) > 0;
+	flow->window = flow->on ? getrcvbuf(sim) : INT_MAX;   /* B starts out empty */
+	flow->rto = rto;
+	flow->interval = rto;
+	SAVE_STATE(sim, flow->window);
+	SAVE_STATE(sim, flow->interval);
+}
+
+/**
+ * function for taking the window edge an ACK advertises
+ *
+ * Duplicate ACKs and the answers to probes carry it as well. The edge
+ * never moves back: B never takes back buffer space it has offered.
+ *
+ * @param edge The ACK's seqnum
+ * @return TRUE if the window opened further
+ */
+int flow_ack(struct sim_state *sim, int edge)
+{
+	struct flow_state *flow = &sim->flow;
+
+	if (!flow->on || edge <= flow->window){
+		return FALSE;
+	}
+	flow->window = edge;
+	flow->interval = flow->rto;
+	return TRUE;
+}
+
+/* caps the sequence number the sender may send up to at the advertised edge */
+int flow_limit(struct sim_state *sim, int limit)
+{
+	return limit < sim->flow.window ? limit : sim->flow.window;
+}
+
+/**
+ * function for (re)starting or stopping the persist timer after sending
+ *
+ * @param nextseqnum Next sequence number to send
+ * @param npkts Packets buffered so far, so nextseqnum < npkts if any wait
+ * @param inflight Packets sent and not yet ACKed
+ */
+void flow_idle(struct sim_state *sim, int nextseqnum, int npkts, int inflight)
+{
+	struct flow_state *flow = &sim->flow;
+
+	if (!flow->on){
+		return;
+	}
+	if (nextseqnum < npkts && nextseqnum >= flow->window && inflight == 0){
+		if (!lt_running(sim, TIMER_PERSIST)){
+			lt_start(sim, TIMER_PERSIST, flow->interval);
+		}
+	}
+	else {
+		lt_stop(sim, TIMER_PERSIST);
+	}
+}
+
+/**
+ * function called when TIMER_PERSIST goes off
+ *
+ * @return TRUE if the sender should probe with packet nextseqnum,
+ *         which it sends without moving nextseqnum past it
+ */
+int flow_persist(struct sim_state *sim, int nextseqnum, int npkts, int inflight)
+{
+	struct flow_state *flow = &sim->flow;
+
+	if (nextseqnum >= npkts || nextseqnum < flow->window || inflight > 0){
+		return FALSE;
+	}
+	report_probe(sim, A);
+	flow->interval = flow->interval * 2 < PERSIST_MAX * flow->rto ? flow->interval * 2 : PERSIST_MAX * flow->rto;
+	lt_start(sim, TIMER_PERSIST, flow->interval);
+	return TRUE;
+}
+
+/* B: whether packet seqnum fits in the receive buffer, given the next one it expects */
+int flow_fits(struct sim_state *sim, int seqnum, int expected)
+{
+	return getrcvbuf(sim) == 0 || seqnum < expected + getrcvfree(sim);
+}
+
+/* B: the window edge to put in an ACK, given the next sequence number it expects */
+int flow_edge(struct sim_state *sim, int expected)
+{
+	if (getrcvbuf(sim) == 0){
+		return 1;
+	}
+	return expected + getrcvfree(sim);
+}
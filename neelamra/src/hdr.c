@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "../include/hdr.h"
+
+/* ******************************************************************
+   Constant-memory latency histogram.
+
+   A value v below 2^S (S = HDR_SUB_BITS) has its own bucket. Above
+   that, with e = msb(v) - S + 1, v falls in bucket
+   e * 2^(S-1) + (v >> e), so every power of two is split into 2^(S-1)
+   equal buckets and the bucket width is below 1/2^(S-1) of the value.
+ **********************************************************************/
+
+int hdr_index(uint64_t value)
+{
+	int e;
+	if (value < (1ULL << HDR_SUB_BITS))
+		return (int)value;
+	e = 63 - __builtin_clzll(value) - HDR_SUB_BITS + 1;
+	return (e << (HDR_SUB_BITS - 1)) + (int)(value >> e);
+}
+
+/* highest value that falls in the bucket */
+uint64_t hdr_value(int index)
+{
+	int e;
+	uint64_t mant;
+	if (index < (1 << HDR_SUB_BITS))
+		return index;
+	e = (index >> (HDR_SUB_BITS - 1)) - 1;
+	mant = index - ((uint64_t)e << (HDR_SUB_BITS - 1));
+	return ((mant + 1) << e) - 1;
+}
+
+void hdr_init(struct hdr_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void hdr_record(struct hdr_hist *h, uint64_t value)
+{
+	h->counts[hdr_index(value)]++;
+	h->total++;
+	if (value > h->max)
+		h->max = value;
+}
+
+/**
+ * function for reading a percentile off the histogram
+ *
+ * @param h Histogram
+ * @param percentile Percentile in [0, 100]
+ * @return highest value equivalent to the percentile, capped at the maximum seen
+ */
+uint64_t hdr_percentile(const struct hdr_hist *h, double percentile)
+{
+	uint64_t rank, seen = 0, value;
+	int i;
+
+	if (h->total == 0)
+		return 0;
+	rank = (uint64_t)(percentile / 100.0 * h->total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HDR_NBUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= rank) {
+			value = hdr_value(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
+
+void hdr_merge(struct hdr_hist *dst, const struct hdr_hist *src)
+{
+	int i;
+	for (i = 0; i < HDR_NBUCKETS; i++)
+		dst->counts[i] += src->counts[i];
+	dst->total += src->total;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
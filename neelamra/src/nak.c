@@ -0,0 +1,162 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/proto.h"
+#include "../include/nak.h"
+
+/* ******************************************************************
+   Negative acknowledgements for the windowed protocols.
+
+   Without NAKs the sender learns of a loss only when its timeout runs
+   out. With them, B reports the holes below the highest sequence
+   number it has seen as soon as a packet arrives past one, and A
+   resends what is listed at once. B sends the first NAK for a hole
+   immediately and holds later ones back for a retransmission timeout,
+   on B's simulator timer, so that a burst of packets past the same
+   hole costs one NAK and a lost NAK or retransmission is reported
+   again. The hold-off doubles while the first hole stays the same.
+   A in turn ignores NAKs for packets it resent less than a timeout
+   ago, whose retransmission may still be on its way.
+ **********************************************************************/
+
+#include<string.h>
+
+#define B 1
+#define TRUE 1
+#define FALSE 0
+#define NAK_MAX 8        /* longest hold-off, in retransmission timeouts */
+
+/**
+ * function for setting up B's NAKs
+ *
+ * @param rto Retransmission timeout, the hold-off after a NAK for a new hole
+ * @param has Whether B holds (or has delivered) a sequence number
+ */
+void nak_init(struct sim_state *sim, float rto, int (*has)(struct sim_state *sim, int seqnum))
+{
+	struct nak_state *nak = &sim->nak;
+
+	nak->on = getnak(sim);
+	nak->rto = rto;
+	nak->interval = rto;
+	nak->first = -1;
+	nak->has = has;
+	nak->high = 0;
+	nak->next = 0.0;
+	nak->armed = FALSE;
+	SAVE_STATE(sim, nak->interval);
+	SAVE_STATE(sim, nak->first);
+	SAVE_STATE(sim, nak->high);
+	SAVE_STATE(sim, nak->next);
+	SAVE_STATE(sim, nak->armed);
+}
+
+/* B: sends a NAK for the holes in [expected, high), if there still are any */
+void nak_send(struct sim_state *sim, int expected)
+{
+	struct nak_state *nak = &sim->nak;
+	struct pkt packet;
+	int first, i;
+
+	for (first = expected; first < nak->high && nak->has(sim, first); first++)
+		;
+	if (first >= nak->high){
+		return;
+	}
+	packet.seqnum = first;
+	packet.acknum = NAK_ACKNUM;
+	memset(packet.payload, 0, PAYLOAD_LEN);
+	for (i = 1; i < NAK_SPAN && first + i < nak->high; i++){
+		if (!nak->has(sim, first + i)){
+			packet.payload[(i - 1) >> 3] |= 1 << ((i - 1) & 7);
+		}
+	}
+	packet.checksum = compute_checksum(packet.seqnum, packet.acknum, packet.payload);
+	tolayer3(sim, B, packet);
+	report_nak(sim, B);
+
+	/* backing off while the same hole stays open, as A may be slow to fill it */
+	if (first == nak->first){
+		nak->interval = nak->interval * 2 < NAK_MAX * nak->rto ? nak->interval * 2 : NAK_MAX * nak->rto;
+	}
+	else {
+		nak->interval = nak->rto;
+	}
+	nak->first = first;
+	nak->next = get_sim_time(sim) + nak->interval;
+}
+
+/* B: (re)arms B's timer for the next NAK while holes remain */
+void nak_hold(struct sim_state *sim, int expected)
+{
+	struct nak_state *nak = &sim->nak;
+
+	if (nak->armed || expected >= nak->high){
+		return;
+	}
+	starttimer(sim, B, nak->next - get_sim_time(sim));
+	nak->armed = TRUE;
+}
+
+/**
+ * function called by B for a packet past the next one it expects
+ *
+ * @param expected First sequence number B has not delivered
+ * @param seen Sequence number of the packet, greater than expected
+ */
+void nak_gap(struct sim_state *sim, int expected, int seen)
+{
+	struct nak_state *nak = &sim->nak;
+	int fresh;
+
+	if (!nak->on){
+		return;
+	}
+	fresh = expected >= nak->high;
+	if (seen + 1 > nak->high){
+		nak->high = seen + 1;
+	}
+	/* a new hole is reported at once, older ones when the hold-off is over */
+	if (fresh || get_sim_time(sim) >= nak->next){
+		nak_send(sim, expected);
+	}
+	nak_hold(sim, expected);
+}
+
+/* B: called when B's timer goes off */
+void nak_timeout(struct sim_state *sim, int expected)
+{
+	struct nak_state *nak = &sim->nak;
+
+	nak->armed = FALSE;
+	if (!nak->on){
+		return;
+	}
+	nak_send(sim, expected);
+	nak_hold(sim, expected);
+}
+
+/* A: whether a packet from B is a NAK */
+int nak_is(struct pkt packet)
+{
+	return packet.acknum == NAK_ACKNUM;
+}
+
+/**
+ * function for reading the sequence numbers a NAK lists
+ *
+ * @param packet The NAK
+ * @param seqnums Output, room for NAK_SPAN sequence numbers in increasing order
+ * @return How many there are
+ */
+int nak_list(struct pkt packet, int *seqnums)
+{
+	int i, n = 0;
+
+	seqnums[n++] = packet.seqnum;
+	for (i = 1; i < NAK_SPAN; i++){
+		if (packet.payload[(i - 1) >> 3] & (1 << ((i - 1) & 7))){
+			seqnums[n++] = packet.seqnum + i;
+		}
+	}
+	return n;
+}
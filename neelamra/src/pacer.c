@@ -0,0 +1,126 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/pacer.h"
+#include "../include/timers.h"
+#include "../include/cc.h"
+
+/* ******************************************************************
+   Pacer for the windowed senders.
+
+   Instead of handing a whole window to layer 3 back to back, packets
+   are queued here and released one every interval on the TIMER_PACE
+   logical timer. The interval is 1/rate for a configured rate, or
+   SRTT/window so that one window is spread over one round trip.
+   Packets stay in the protocol's own buffer; the queue only holds
+   their offsets from the queue itself (so a snapshot of it stays valid
+   in a new process) and stamps their send time on release.
+ **********************************************************************/
+
+#include<stdio.h>
+#include<stddef.h>
+
+#define A 0
+#define TRUE 1
+#define FALSE 0
+#define SRTT_GAIN 0.125
+
+void pacer_init(struct sim_state *sim, float rate, float srtt)
+{
+	struct pacer_state *pacer = &sim->pacer;
+
+	pacer->rate = rate;
+	pacer->srtt = srtt;
+	pacer->head = 0;
+	pacer->len = 0;
+	pacer->next = 0.0;
+	SAVE_STATE(sim, pacer->queue);
+	SAVE_STATE(sim, pacer->head);
+	SAVE_STATE(sim, pacer->len);
+	SAVE_STATE(sim, pacer->rate);
+	SAVE_STATE(sim, pacer->srtt);
+	SAVE_STATE(sim, pacer->next);
+}
+
+float pacer_interval(struct sim_state *sim)
+{
+	struct pacer_state *pacer = &sim->pacer;
+
+	if (pacer->rate > 0){
+		return 1.0 / pacer->rate;
+	}
+	return pacer->srtt / cc_window(sim);
+}
+
+/* puts a packet on the wire and schedules the slot after it */
+void pacer_transmit(struct sim_state *sim, struct pacer_entry entry)
+{
+	struct pacer_state *pacer = &sim->pacer;
+	double curr_time = get_sim_time(sim);
+	struct pkt *packet = (struct pkt *)((char *)pacer->queue + entry.packet);
+	double *sent_time = (double *)((char *)pacer->queue + entry.sent_time);
+	tolayer3(sim, A, *packet);
+	*sent_time = curr_time;
+	pacer->next = curr_time + pacer_interval(sim);
+}
+
+/**
+ * function for sending a packet through the pacer
+ *
+ * @param packet Packet to send, must stay valid until it leaves the pacer
+ * @param sent_time Set to the time the packet is actually handed to layer 3
+ */
+void pacer_send(struct sim_state *sim, struct pkt *packet, double *sent_time)
+{
+	struct pacer_state *pacer = &sim->pacer;
+	struct pacer_entry entry;
+	double curr_time = get_sim_time(sim);
+
+	entry.packet = (char *)packet - (char *)pacer->queue;
+	entry.sent_time = (char *)sent_time - (char *)pacer->queue;
+	*sent_time = curr_time;
+	if (pacer->rate < 0 || (pacer->len == 0 && curr_time >= pacer->next)){
+		pacer_transmit(sim, entry);
+		return;
+	}
+	if (pacer->len == PACER_QSIZE){
+		/* queue full: falling back to sending unpaced */
+		pacer_transmit(sim, entry);
+		return;
+	}
+	pacer->queue[(pacer->head + pacer->len) % PACER_QSIZE] = entry;
+	pacer->len++;
+	if (!lt_running(sim, TIMER_PACE)){
+		lt_start(sim, TIMER_PACE, pacer->next - curr_time);
+	}
+}
+
+/* drops packets still waiting in the pacer, e.g. before a go-back-N resend */
+void pacer_flush(struct sim_state *sim)
+{
+	struct pacer_state *pacer = &sim->pacer;
+
+	pacer->len = 0;
+	lt_stop(sim, TIMER_PACE);
+}
+
+/* called when TIMER_PACE goes off: releases the packet at the head of the queue */
+void pacer_timeout(struct sim_state *sim)
+{
+	struct pacer_state *pacer = &sim->pacer;
+
+	if (pacer->len == 0){
+		return;
+	}
+	pacer_transmit(sim, pacer->queue[pacer->head]);
+	pacer->head = (pacer->head + 1) % PACER_QSIZE;
+	pacer->len--;
+	if (pacer->len > 0){
+		lt_start(sim, TIMER_PACE, pacer->next - get_sim_time(sim));
+	}
+}
+
+/* updates the smoothed round trip time with a new sample */
+void pacer_rtt_sample(struct sim_state *sim, float rtt)
+{
+	sim->pacer.srtt += SRTT_GAIN * (rtt - sim->pacer.srtt);
+}
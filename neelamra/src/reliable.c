@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "../include/sim.h"
+#include "../include/proto.h"
+#include "../include/reliable.h"
+
+/* ******************************************************************
+   libreliable: contexts, protocol selection and running a simulation.
+
+   The library holds one simulator, built with -DRELIABLE_LIB, and the
+   three protocols, each behind its struct sim_protocol. A context
+   owns a struct sim_state, allocated once by reliable_create() and
+   reset before every run to what a fresh abt/gbn/sr starts from; a
+   run goes in the caller's thread with its output turned off. A
+   verification failure leaves the run through sim_exit(), which
+   longjmp()s back to reliable_run() with the code it ends abt/gbn/sr
+   with instead of exiting; the event it was handling is freed there
+   with the rest of the event list.
+ **********************************************************************/
+
+extern const struct sim_protocol abt_protocol, gbn_protocol, sr_protocol;
+
+static const struct {
+	const char *name;
+	const struct sim_protocol *protocol;
+} reliable_protocols[] = {
+	{"abt", &abt_protocol},
+	{"gbn", &gbn_protocol},
+	{"sr",  &sr_protocol},
+};
+
+struct reliable_sim {
+	struct reliable_config cfg;
+	const struct sim_protocol *protocol;
+	struct sim_state *state;    /* reset before each run */
+	struct reliable_stats stats;
+};
+
+/**
+ * function for setting a config to the defaults of the command line
+ *
+ * @param cfg Config to set, protocol "sr"
+ */
+void reliable_config_init(struct reliable_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->protocol = "sr";
+	cfg->seed = 1;
+	cfg->window = 8;
+	cfg->messages = 1000;
+	cfg->interarrival = 10.0;
+	cfg->delay = 5.0;
+	cfg->queue = 50;
+	cfg->qdisc = RELIABLE_QDISC_FIFO;
+	cfg->cc = RELIABLE_CC_NONE;
+	cfg->pace = -1.0;
+}
+
+/* whether cfg is within what the command line accepts */
+static int reliable_config_ok(const struct reliable_config *cfg)
+{
+	if (cfg->seed < 0 || cfg->window < 1 || cfg->window > PROTO_RING || cfg->messages < 0 || cfg->interarrival <= 0.0)
+		return 0;
+	if (cfg->loss < 0.0 || cfg->loss > 1.0 || cfg->corruption < 0.0 || cfg->corruption > 1.0)
+		return 0;
+	if (cfg->bandwidth < 0.0 || cfg->delay < 0.0 || cfg->queue < 1 || cfg->timeout < 0.0)
+		return 0;
+	if (cfg->qdisc != RELIABLE_QDISC_FIFO && cfg->qdisc != RELIABLE_QDISC_RED)
+		return 0;
+	if (cfg->cc != RELIABLE_CC_NONE && cfg->cc != RELIABLE_CC_AIMD && cfg->cc != RELIABLE_CC_CUBIC)
+		return 0;
+	if (cfg->fec_block != 0 && (cfg->fec_block < 1 || cfg->fec_block > FEC_MAXK ||
+				cfg->fec_parity < 0 || cfg->fec_parity > FEC_MAXM))
+		return 0;
+	if (cfg->msg_size < 0 || cfg->msg_size > SEG_MAXMSG)
+		return 0;
+	if (cfg->mtu != 0 && (cfg->mtu <= SEG_HDR_LEN || cfg->mtu > PAYLOAD_LEN))
+		return 0;
+	if (cfg->rcvbuf < 0 || (cfg->rcvbuf == 0) != (cfg->drain <= 0.0))
+		return 0;
+	if (cfg->sndbuf < 0 || cfg->warmup < 0.0 || cfg->complete_limit < 0.0 || cfg->max_events < 0)
+		return 0;
+	return 1;
+}
+
+/**
+ * function for making a simulation context
+ *
+ * @param cfg Configuration, copied into the context
+ * @return The context, or NULL if the protocol is unknown, the
+ *         configuration out of range or there is no memory
+ */
+struct reliable_sim *reliable_create(const struct reliable_config *cfg)
+{
+	struct reliable_sim *sim;
+	size_t i;
+
+	if (cfg->protocol == NULL || !reliable_config_ok(cfg))
+		return NULL;
+	for (i = 0; i < sizeof(reliable_protocols) / sizeof(reliable_protocols[0]); i++)
+		if (strcmp(cfg->protocol, reliable_protocols[i].name) == 0)
+			break;
+	if (i == sizeof(reliable_protocols) / sizeof(reliable_protocols[0]))
+		return NULL;
+	if ((sim = (struct reliable_sim *)calloc(1, sizeof(*sim))) == NULL)
+		return NULL;
+	sim->cfg = *cfg;
+	sim->cfg.protocol = reliable_protocols[i].name;
+	sim->protocol = reliable_protocols[i].protocol;
+	sim->stats.completion_time = -1.0;
+	if ((sim->state = sim_alloc(sim->protocol)) == NULL) {
+		free(sim);
+		return NULL;
+	}
+	return sim;
+}
+
+/* sets up a simulation's state as the command line would for cfg */
+static void reliable_setup(struct sim_state *s, const struct reliable_config *cfg)
+{
+	sim_reset(s);
+	sim_defaults(s);
+	s->TRACE = -1;
+	s->progname = (char *)cfg->protocol;
+	s->seed = cfg->seed;
+	s->win_size = cfg->window;
+	s->nsimmax = cfg->messages;
+	s->lossprob = cfg->loss;
+	s->corruptprob = cfg->corruption;
+	s->lambda = cfg->interarrival;
+	s->bandwidth = cfg->bandwidth;
+	s->propdelay = cfg->delay;
+	s->qlimit = cfg->queue;
+	s->qdisc = cfg->qdisc == RELIABLE_QDISC_RED ? QDISC_RED : QDISC_FIFO;
+	s->timeout = cfg->timeout;
+	s->cc_algo = cfg->cc == RELIABLE_CC_AIMD ? CC_AIMD : cfg->cc == RELIABLE_CC_CUBIC ? CC_CUBIC : CC_NONE;
+	s->pace_rate = cfg->pace;
+	s->fec_block = cfg->fec_block;
+	s->fec_parity = cfg->fec_parity;
+	s->harq = cfg->harq;
+	s->use_nak = cfg->nak;
+	s->msg_size = cfg->msg_size;
+	s->mtu = cfg->mtu > 0 ? cfg->mtu : PAYLOAD_LEN;
+	s->wire = cfg->wire;
+	s->rcvbuf = cfg->rcvbuf;
+	s->drain_rate = cfg->drain;
+	s->sndbuf = cfg->sndbuf;
+	s->warmup = cfg->warmup;
+	s->complete = cfg->complete;
+	s->complete_limit = cfg->complete_limit;
+	s->max_events = cfg->max_events;
+}
+
+/* reads what the JSON summary would report off a finished simulation */
+static void reliable_collect(struct sim_state *s, struct reliable_stats *st)
+{
+	st->time = s->time;
+	st->events = s->nevents;
+	st->A_application = s->A_application;
+	st->A_transport = s->A_transport;
+	st->B_transport = s->B_transport;
+	st->B_application = s->B_application;
+	st->retransmissions = s->nretrans;
+	st->lost = s->nlost;
+	st->corrupted = s->ncorrupt;
+	st->queue_drops = s->nqdrop;
+	st->max_queue = s->maxqdepth;
+	st->naks = s->nnaks;
+	st->latency_p50 = latency_at(&s->latency, 50);
+	st->latency_p90 = latency_at(&s->latency, 90);
+	st->latency_p99 = latency_at(&s->latency, 99);
+	st->latency_p99_9 = latency_at(&s->latency, 99.9);
+	st->latency_max = latency_at(&s->latency, 100);
+	st->throughput = s->time > 0 ? s->A_transport/s->time : 0.0;
+	st->goodput = s->time > 0 ? s->B_application/s->time : 0.0;
+	st->bytes_delivered = s->bytes_delivered;
+	st->steady_goodput = measured_goodput(s);
+	st->steady_latency_p50 = latency_at(measured_latency(s), 50);
+	st->steady_latency_p99 = latency_at(measured_latency(s), 99);
+	st->completion_time = s->done_at;
+}
+
+/**
+ * function for running a simulation, which may be run again
+ *
+ * The run uses the context's own simulator state, so runs of different
+ * contexts may go at once from different threads; a context runs one at
+ * a time.
+ *
+ * @param sim Context to run, whose statistics are replaced on success
+ * @return 0 on success, a simulator exit code above 0 if the run failed
+ *         verification, RELIABLE_EINVAL or RELIABLE_ESYS
+ */
+int reliable_run(struct reliable_sim *sim)
+{
+	struct sim_state *s = sim->state;
+	jmp_buf bail;
+	volatile int code;
+
+	reliable_setup(s, &sim->cfg);
+	s->bail = &bail;
+	if (setjmp(bail) == 0)
+		code = sim_run(s) < 0 ? RELIABLE_EINVAL : 0;
+	else if (s->exit_code == 0)
+		code = RELIABLE_ESYS;       /* the random number generator failed its check */
+	else
+		code = s->exit_code;
+	if (code == 0)
+		reliable_collect(s, &sim->stats);
+	/* after a sim_exit() this frees s->cur_event, off the list, as well */
+	clear_events(s);
+	return code;
+}
+
+/**
+ * function for reading the statistics of the last successful run
+ *
+ * @param sim Context
+ * @return Its statistics, all zero (completion_time -1) before a run
+ */
+const struct reliable_stats *reliable_stats(const struct reliable_sim *sim)
+{
+	return &sim->stats;
+}
+
+void reliable_destroy(struct reliable_sim *sim)
+{
+	free(sim->state);
+	free(sim);
+}
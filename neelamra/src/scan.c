@@ -0,0 +1,371 @@
+#include "../include/proto.h"
+#include "../include/scan.h"
+
+/* the kernels follow the ISA the build targets; -DSCAN_SCALAR forces plain C */
+#if !defined(SCAN_SCALAR) && defined(__AVX2__)
+#define SCAN_AVX2
+#elif !defined(SCAN_SCALAR) && defined(__SSE2__)
+#define SCAN_SSE2
+#endif
+
+#if defined(SCAN_AVX2) || defined(SCAN_SSE2)
+#include <immintrin.h>
+#endif
+
+/* ******************************************************************
+   Vectorized window scans for the selective repeat sender.
+
+   A scan over sequence numbers [from, to) goes a bitset word at a
+   time: the unACKed bits of the word say which of its 64 send times
+   count, words with none are skipped, and the rest are handled 4 (AVX2)
+   or 2 (SSE2) send times per instruction, with the ACKed lanes masked
+   out. The running minimum stays in a vector register until the end of
+   the scan, and words with only a few unACKed packets are visited one
+   by one. The results are exactly those of the scalar loops, so switching
+   kernels never changes a simulation.
+ **********************************************************************/
+
+#if defined(SCAN_AVX2)
+const char *const SCAN_ISA = "avx2";
+#elif defined(SCAN_SSE2)
+const char *const SCAN_ISA = "sse2";
+#else
+const char *const SCAN_ISA = "scalar";
+#endif
+
+/* the unACKed bits of the word holding seqnum, for [seqnum, to), at their slot positions */
+static inline uint64_t word_unacked(const uint64_t *acked, int seqnum, int to)
+{
+	return ring_clear_bits(acked, seqnum, to) << (seqnum & 63);
+}
+
+/* ---------------------------------------------------------------- */
+/* scalar reference                                                  */
+/* ---------------------------------------------------------------- */
+
+double scan_oldest_scalar(const double *start_time, const uint64_t *acked, int from, int to, double oldest)
+{
+	uint64_t m;
+	int seq;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		for (m = word_unacked(acked, seq, to); m != 0; m &= m - 1){
+			if (start_time[ring_slot(seq & ~63) + __builtin_ctzll(m)] < oldest){
+				oldest = start_time[ring_slot(seq & ~63) + __builtin_ctzll(m)];
+			}
+		}
+	}
+	return oldest;
+}
+
+int scan_next_unacked_scalar(const uint64_t *acked, int from, int to)
+{
+	return ring_next_clear(acked, from, to);
+}
+
+int scan_first_expired_scalar(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit)
+{
+	uint64_t m;
+	int seq;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		for (m = word_unacked(acked, seq, to); m != 0; m &= m - 1){
+			if (timerval - (curr_time - start_time[ring_slot(seq & ~63) + __builtin_ctzll(m)]) < limit){
+				return (seq & ~63) + __builtin_ctzll(m);
+			}
+		}
+	}
+	return to;
+}
+
+int scan_expired_scalar(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit, uint64_t *expired)
+{
+	uint64_t m;
+	int seq, n = 0;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		for (m = word_unacked(acked, seq, to); m != 0; m &= m - 1){
+			if (timerval - (curr_time - start_time[ring_slot(seq & ~63) + __builtin_ctzll(m)]) < limit){
+				expired[ring_slot(seq) >> 6] |= m & -m;
+				n++;
+			}
+		}
+	}
+	return n;
+}
+
+/* ---------------------------------------------------------------- */
+/* per word kernels: t holds the 64 send times of the word, m the    */
+/* slots that count                                                  */
+/* ---------------------------------------------------------------- */
+
+#if defined(SCAN_AVX2)
+
+typedef __m256d scan_min_t;
+#define scan_min_init(x) _mm256_set1_pd(x)
+
+static inline scan_min_t word_min(scan_min_t vmin, const double *t, uint64_t m)
+{
+	const __m256i sel = _mm256_setr_epi64x(1, 2, 4, 8);
+	__m256i lanes;
+	unsigned bits;
+	int k;
+
+	for (k = 0; k < 16; k++){
+		if ((bits = (m >> (4 * k)) & 0xf) == 0){
+			continue;
+		}
+		lanes = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(bits), sel), sel);
+		vmin = _mm256_min_pd(vmin, _mm256_blendv_pd(vmin, _mm256_loadu_pd(t + 4 * k),
+					_mm256_castsi256_pd(lanes)));
+	}
+	return vmin;
+}
+
+static inline double scan_min_reduce(scan_min_t vmin)
+{
+	__m128d lo = _mm_min_pd(_mm256_castpd256_pd128(vmin), _mm256_extractf128_pd(vmin, 1));
+	lo = _mm_min_sd(lo, _mm_unpackhi_pd(lo, lo));
+	return _mm_cvtsd_f64(lo);
+}
+
+static inline uint64_t word_expired(const double *t, uint64_t m, double curr_time, double timerval, double limit)
+{
+	__m256d vcurr = _mm256_set1_pd(curr_time), vtimer = _mm256_set1_pd(timerval), vlim = _mm256_set1_pd(limit);
+	__m256d left;
+	uint64_t expired = 0;
+	int k;
+
+	for (k = 0; k < 16; k++){
+		if (((m >> (4 * k)) & 0xf) == 0){
+			continue;
+		}
+		left = _mm256_sub_pd(vtimer, _mm256_sub_pd(vcurr, _mm256_loadu_pd(t + 4 * k)));
+		expired |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(left, vlim, _CMP_LT_OQ)) << (4 * k);
+	}
+	return expired & m;
+}
+
+/* whether the 4 words from w on are all ACKed */
+static inline int words_full(const uint64_t *acked, int w)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *)(acked + w));
+	return _mm256_testc_si256(v, _mm256_set1_epi64x(-1));
+}
+#define SCAN_WORDS 4
+#define SCAN_SPARSE 4
+
+#elif defined(SCAN_SSE2)
+
+typedef __m128d scan_min_t;
+#define scan_min_init(x) _mm_set1_pd(x)
+
+static inline scan_min_t word_min(scan_min_t vmin, const double *t, uint64_t m)
+{
+	__m128d lanes;
+	unsigned bits;
+	int k;
+
+	for (k = 0; k < 32; k++){
+		if ((bits = (m >> (2 * k)) & 0x3) == 0){
+			continue;
+		}
+		lanes = _mm_castsi128_pd(_mm_set_epi64x(-(long long)(bits >> 1), -(long long)(bits & 1)));
+		vmin = _mm_min_pd(vmin, _mm_or_pd(_mm_and_pd(lanes, _mm_loadu_pd(t + 2 * k)),
+					_mm_andnot_pd(lanes, vmin)));
+	}
+	return vmin;
+}
+
+static inline double scan_min_reduce(scan_min_t vmin)
+{
+	vmin = _mm_min_sd(vmin, _mm_unpackhi_pd(vmin, vmin));
+	return _mm_cvtsd_f64(vmin);
+}
+
+static inline uint64_t word_expired(const double *t, uint64_t m, double curr_time, double timerval, double limit)
+{
+	__m128d vcurr = _mm_set1_pd(curr_time), vtimer = _mm_set1_pd(timerval), vlim = _mm_set1_pd(limit);
+	__m128d left;
+	uint64_t expired = 0;
+	int k;
+
+	for (k = 0; k < 32; k++){
+		if (((m >> (2 * k)) & 0x3) == 0){
+			continue;
+		}
+		left = _mm_sub_pd(vtimer, _mm_sub_pd(vcurr, _mm_loadu_pd(t + 2 * k)));
+		expired |= (uint64_t)_mm_movemask_pd(_mm_cmplt_pd(left, vlim)) << (2 * k);
+	}
+	return expired & m;
+}
+
+/* whether the 2 words from w on are all ACKed */
+static inline int words_full(const uint64_t *acked, int w)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *)(acked + w));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-1))) == 0xffff;
+}
+#define SCAN_WORDS 2
+#define SCAN_SPARSE 4
+
+#else
+
+typedef double scan_min_t;
+#define scan_min_init(x) (x)
+#define scan_min_reduce(x) (x)
+
+static inline scan_min_t word_min(scan_min_t oldest, const double *t, uint64_t m)
+{
+	for (; m != 0; m &= m - 1){
+		if (t[__builtin_ctzll(m)] < oldest){
+			oldest = t[__builtin_ctzll(m)];
+		}
+	}
+	return oldest;
+}
+
+static inline uint64_t word_expired(const double *t, uint64_t m, double curr_time, double timerval, double limit)
+{
+	uint64_t expired = 0;
+	for (; m != 0; m &= m - 1){
+		if (timerval - (curr_time - t[__builtin_ctzll(m)]) < limit){
+			expired |= m & -m;
+		}
+	}
+	return expired;
+}
+
+static inline int words_full(const uint64_t *acked, int w)
+{
+	return acked[w] == ~0ULL;
+}
+#define SCAN_WORDS 1
+#define SCAN_SPARSE 64
+
+#endif
+
+/* ---------------------------------------------------------------- */
+/* scans                                                             */
+/* ---------------------------------------------------------------- */
+
+/**
+ * function for finding the earliest send time among the unACKed packets
+ *
+ * @param start_time Send times, indexed by ring slot
+ * @param acked ACKed bitset
+ * @param from First sequence number of the window
+ * @param to One past the last sequence number of the window
+ * @param oldest Returned if it is earlier than every unACKed packet
+ * @return The earliest send time
+ */
+double scan_oldest(const double *start_time, const uint64_t *acked, int from, int to, double oldest)
+{
+	scan_min_t vmin = scan_min_init(oldest);
+	const double *t;
+	uint64_t m;
+	int seq;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		m = word_unacked(acked, seq, to);
+		t = start_time + ring_slot(seq & ~63);
+		/* a few unACKed packets are cheaper to visit one by one */
+		if (__builtin_popcountll(m) > SCAN_SPARSE){
+			vmin = word_min(vmin, t, m);
+			continue;
+		}
+		for (; m != 0; m &= m - 1){
+			if (t[__builtin_ctzll(m)] < oldest){
+				oldest = t[__builtin_ctzll(m)];
+			}
+		}
+	}
+	oldest = scan_min_reduce(vmin) < oldest ? scan_min_reduce(vmin) : oldest;
+	return oldest;
+}
+
+/**
+ * function for finding the first unACKed packet
+ *
+ * @param acked ACKed bitset
+ * @param from First sequence number to look at
+ * @param to One past the last sequence number to look at
+ * @return The sequence number, or to if all are ACKed
+ */
+int scan_next_unacked(const uint64_t *acked, int from, int to)
+{
+	int w;
+	/* up to a word boundary, then SCAN_WORDS fully ACKed words per step */
+	if (from < to && (from & 63) != 0){
+		if (word_unacked(acked, from, to) != 0){
+			return ring_next_clear(acked, from, to);
+		}
+		from += 64 - (from & 63);
+	}
+	while (to - from >= 64 * SCAN_WORDS){
+		w = ring_slot(from) >> 6;
+		if (w + SCAN_WORDS > RING_WORDS || !words_full(acked, w)){
+			break;
+		}
+		from += 64 * SCAN_WORDS;
+	}
+	return ring_next_clear(acked, from, to);
+}
+
+/**
+ * function for finding the first unACKed packet whose timer has run out,
+ * i.e. with timerval - (curr_time - start_time) < limit
+ *
+ * @param start_time Send times, indexed by ring slot
+ * @param acked ACKed bitset
+ * @param from First sequence number of the window
+ * @param to One past the last sequence number of the window
+ * @param curr_time Current time
+ * @param timerval Retransmission timeout
+ * @param limit Time left below which a timer counts as run out
+ * @return The sequence number, or to if none has run out
+ */
+int scan_first_expired(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit)
+{
+	uint64_t m;
+	int seq;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		if ((m = word_unacked(acked, seq, to)) == 0){
+			continue;
+		}
+		m = word_expired(start_time + ring_slot(seq & ~63), m, curr_time, timerval, limit);
+		if (m != 0){
+			return (seq & ~63) + __builtin_ctzll(m);
+		}
+	}
+	return to;
+}
+
+/**
+ * function for finding all the unACKed packets whose timer has run out,
+ * by the test of scan_first_expired()
+ *
+ * @param start_time Send times, indexed by ring slot
+ * @param acked ACKed bitset
+ * @param from First sequence number of the window
+ * @param to One past the last sequence number of the window
+ * @param curr_time Current time
+ * @param timerval Retransmission timeout
+ * @param limit Time left below which a timer counts as run out
+ * @param expired Bitset like acked the packets found are set in; other bits are left alone
+ * @return How many were found
+ */
+int scan_expired(const double *start_time, const uint64_t *acked, int from, int to,
+		double curr_time, float timerval, double limit, uint64_t *expired)
+{
+	uint64_t m;
+	int seq, n = 0;
+	for (seq = from; seq < to; seq += 64 - (seq & 63)){
+		if ((m = word_unacked(acked, seq, to)) == 0){
+			continue;
+		}
+		m = word_expired(start_time + ring_slot(seq & ~63), m, curr_time, timerval, limit);
+		expired[ring_slot(seq) >> 6] |= m;
+		n += __builtin_popcountll(m);
+	}
+	return n;
+}
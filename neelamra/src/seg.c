@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "../include/sim.h"
+#include "../include/seg.h"
+
+/* ******************************************************************
+   Segmentation and reassembly above the transport.
+
+   The sender cuts a message into segments of up to mtu bytes of
+   packet payload, header included. The receiver copies each segment's
+   data straight to its place in the message being reassembled and,
+   once the last segment is in, hands out that buffer itself, so the
+   data is copied once on its way from the packet to the application.
+ **********************************************************************/
+
+void seg_init(struct sim_state *sim, int mtu)
+{
+	struct seg_state *seg = &sim->seg;
+
+	seg->mtu = mtu;
+	seg->rxlen = 0;
+	SAVE_STATE(sim, seg->rxbuf);
+	SAVE_STATE(sim, seg->rxlen);
+}
+
+/* number of segments a message of len bytes is cut into */
+int seg_count(struct sim_state *sim, int len)
+{
+	int room = sim->seg.mtu - SEG_HDR_LEN;
+	return len == 0 ? 1 : (len + room - 1) / room;
+}
+
+/**
+ * function for cutting a message into segments
+ *
+ * @param data Message
+ * @param len Length of the message in bytes, at most SEG_MAXMSG
+ * @param output Called with each segment in order, e.g. A_output
+ */
+void seg_output(struct sim_state *sim, const char *data, int len, void (*output)(struct sim_state *sim, struct msg))
+{
+	struct msg seg;
+	int room = sim->seg.mtu - SEG_HDR_LEN;
+	int off = 0, n, hdr;
+
+	do {
+		n = len - off < room ? len - off : room;
+		hdr = n | (off + n == len ? SEG_LAST : 0);
+		memset(seg.data, 0, sizeof(seg.data));
+		seg.data[0] = hdr & 0xff;
+		seg.data[1] = hdr >> 8;
+		memcpy(seg.data + SEG_HDR_LEN, data + off, n);
+		off += n;
+		output(sim, seg);
+	} while (off < len);
+}
+
+/**
+ * function for adding a delivered segment to the message being reassembled
+ *
+ * @param data Segment, PAYLOAD_LEN bytes
+ * @param len Set to the length of the message when it is complete
+ * @return The complete message, valid until the next call, or NULL
+ */
+const char *seg_input(struct sim_state *sim, const char *data, int *len)
+{
+	struct seg_state *seg = &sim->seg;
+	int hdr = (unsigned char)data[0] | ((unsigned char)data[1] << 8);
+	int n = hdr & ~SEG_LAST;
+
+	if (n > PAYLOAD_LEN - SEG_HDR_LEN || seg->rxlen + n > SEG_MAXMSG){
+		/* not a segment we made; dropping the partial message */
+		seg->rxlen = 0;
+		return NULL;
+	}
+	memcpy(seg->rxbuf + seg->rxlen, data + SEG_HDR_LEN, n);
+	seg->rxlen += n;
+	if (!(hdr & SEG_LAST)){
+		return NULL;
+	}
+	*len = seg->rxlen;
+	seg->rxlen = 0;
+	return seg->rxbuf;
+}
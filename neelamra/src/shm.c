@@ -0,0 +1,616 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../include/sim.h"
+#include "../include/spsc.h"
+
+/* ******************************************************************
+   Shared-memory transport: A and B as two processes on wall-clock time.
+
+   Instead of the simulated channel, each packet given to tolayer3() is
+   pushed onto a lock-free ring in an anonymous shared mapping, one ring
+   per direction, and the other process polls it. Timers run on the
+   monotonic clock, one time unit being --unit nanoseconds. As in the
+   simulator, time stands still while a protocol routine runs: the
+   clock is read once before each call, so a timer handler that
+   retransmits a long window still finds its timers in the future.
+   With no event list, RNG or system call on the packet path, the
+   protocol is what the packet rate measures.
+
+   A full ring drops the packet, as a router queue would, so that the
+   two processes never wait on each other; -l and -c lose and corrupt
+   packets on top of that. A offers the next message whenever fewer
+   than --backlog are undelivered, and stops once B's application has
+   taken all -m.
+
+   B's application takes each message inside tolayer5(), i.e. inside
+   B_input(), unless --app-thread hands it to a thread of its own: the
+   receive path then only copies the message onto a lock-free queue,
+   which the thread drains in batches. --consume makes the application
+   spend that many nanoseconds on every message. The time from A
+   putting a packet on the ring to B putting its ACK on the other is
+   the ACK turnaround, which a slow consumer inflates when it runs on
+   the receive path.
+ **********************************************************************/
+
+#define A 0
+#define B 1
+#define SHM_SPIN 64          /* idle polls before giving up the CPU */
+#define APP_SLOTS 65536      /* messages queued for B's application, a power of two */
+#define APP_BATCH 64         /* messages the application takes per visit to the queue */
+
+/* what each process counts; written only by its owner */
+struct shm_side {
+	_Alignas(SPSC_LINE) long packets;    /* put into layer 3 */
+	long drops;                          /* found the ring full */
+	long lost;
+	long corrupted;
+	long retransmits;
+};
+
+struct shm_link {
+	struct spsc_ring ring[2];            /* ring[A] carries A's packets to B */
+	struct shm_side side[2];
+	struct hdr_hist turnaround;          /* ns from a packet entering A's ring to B's ACK */
+	_Alignas(SPSC_LINE) _Atomic int delivered;   /* messages B's application has taken */
+	_Alignas(SPSC_LINE) _Atomic int go;          /* both processes are ready */
+	_Atomic int ready;
+	_Atomic int done;
+};
+
+struct shm_link *shm;
+struct sim_state *shm_sim;   /* the protocol's state and its modules' */
+struct spsc_end tx, rx;
+int64_t rx_stamp;            /* stamp of the packet being handled */
+
+/* hand-off from B's receive path to its application thread */
+struct app_queue {
+	_Alignas(SPSC_LINE) _Atomic uint32_t head;
+	_Alignas(SPSC_LINE) _Atomic uint32_t tail;
+	_Alignas(SPSC_LINE) struct msg slots[APP_SLOTS];
+};
+struct app_queue *appq;
+uint32_t app_head, app_tail;   /* producer's index, and the last tail it saw */
+int app_next = 0;              /* next message the application expects */
+
+/* parameters, as in the simulator */
+int win_size;
+int nmsgs;
+float lossprob = 0.0;
+float corruptprob = 0.0;
+int cc_algo = CC_NONE;
+float pace_rate = -1.0;
+int fec_block = 0;
+int fec_parity = 0;
+int harq = 0;
+float timeout = 0.0;
+double unit_ns = 10000.0;    /* nanoseconds per time unit */
+int backlog = 1024;
+int cpus[2] = {-1, -1};
+int app_thread = 0;
+double consume_ns = 0.0;     /* application work per message */
+unsigned int rng;
+
+/* wall clock */
+struct timespec start_ts;
+double go_time;              /* when both processes were ready */
+double sim_time;             /* time of the current call into the protocol */
+int timer_on = 0;
+double timer_at;             /* in time units */
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((ts.tv_sec - start_ts.tv_sec) * 1e9 + (ts.tv_nsec - start_ts.tv_nsec)) / unit_ns;
+}
+
+/* the same clock in ns, comparable between the processes */
+int64_t clock_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* xorshift32: each process draws its own losses */
+float shm_rand()
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return (rng >> 8) / 16777216.0;
+}
+
+void display_usage(char *filename)
+{
+	printf("Usage:\n %s -w Window size -m Number of messages -l Loss -c Corruption -s Seed\n", filename);
+	printf("Transport:\n --unit Nanoseconds per time unit --backlog Undelivered messages A may have --cpus A,B CPUs to pin A and B to\n");
+	printf("Application:\n --app-thread Deliver to B's application on a thread of its own --consume Nanoseconds the application spends per message\n");
+	printf("Sender:\n --timeout Retransmission timeout --cc none|aimd|cubic Congestion control of the gbn/sr window --pace Pace at window/SRTT --pace-rate Pace at packets per time unit --fec K:M Send M parity packets per K data packets --harq Adapt the parity per block to the loss seen in ACKs (sr)\n");
+}
+
+/* long options, returned by getopt_long() as the values below */
+#define  OPT_CC          256
+#define  OPT_PACE        257
+#define  OPT_PACE_RATE   258
+#define  OPT_FEC         259
+#define  OPT_HARQ        260
+#define  OPT_TIMEOUT     261
+#define  OPT_UNIT        262
+#define  OPT_BACKLOG     263
+#define  OPT_CPUS        264
+#define  OPT_APP_THREAD  265
+#define  OPT_CONSUME     266
+
+static struct option long_options[] = {
+	{"cc",        required_argument, 0, OPT_CC},
+	{"pace",      no_argument,       0, OPT_PACE},
+	{"pace-rate", required_argument, 0, OPT_PACE_RATE},
+	{"fec",       required_argument, 0, OPT_FEC},
+	{"harq",      no_argument,       0, OPT_HARQ},
+	{"timeout",   required_argument, 0, OPT_TIMEOUT},
+	{"unit",      required_argument, 0, OPT_UNIT},
+	{"backlog",   required_argument, 0, OPT_BACKLOG},
+	{"cpus",      required_argument, 0, OPT_CPUS},
+	{"app-thread", no_argument,      0, OPT_APP_THREAD},
+	{"consume",   required_argument, 0, OPT_CONSUME},
+	{0, 0, 0, 0}
+};
+
+void invalid(const char *name)
+{
+	fprintf(stderr, "Invalid value for %s\n", name);
+	exit(-1);
+}
+
+void parse_args(int argc, char **argv)
+{
+	int opt;
+	while ((opt = getopt_long(argc, argv, "w:m:l:c:s:", long_options, NULL)) != -1){
+		switch (opt){
+			case 'w':     if ((win_size = atoi(optarg)) < 1) invalid("-w");
+				      break;
+			case 'm':     if ((nmsgs = atoi(optarg)) < 1) invalid("-m");
+				      break;
+			case 'l':     if ((lossprob = atof(optarg)) < 0.0 || lossprob > 1.0) invalid("-l");
+				      break;
+			case 'c':     if ((corruptprob = atof(optarg)) < 0.0 || corruptprob > 1.0) invalid("-c");
+				      break;
+			case 's':     rng = atoi(optarg);
+				      break;
+			case OPT_CC:        if (strcmp(optarg, "none") == 0)
+					      cc_algo = CC_NONE;
+				      else if (strcmp(optarg, "aimd") == 0)
+					      cc_algo = CC_AIMD;
+				      else if (strcmp(optarg, "cubic") == 0)
+					      cc_algo = CC_CUBIC;
+				      else
+					      invalid("--cc");
+				      break;
+			case OPT_PACE:      pace_rate = 0.0;
+				      break;
+			case OPT_PACE_RATE: if ((pace_rate = atof(optarg)) <= 0.0) invalid("--pace-rate");
+				      break;
+			case OPT_FEC:       if (sscanf(optarg, "%d:%d", &fec_block, &fec_parity) != 2 ||
+					      fec_block < 1 || fec_block > 32 || fec_parity < 0 || fec_parity > 8)
+					      invalid("--fec");
+				      break;
+			case OPT_HARQ:      harq = 1;
+				      break;
+			case OPT_TIMEOUT:   if ((timeout = atof(optarg)) <= 0.0) invalid("--timeout");
+				      break;
+			case OPT_UNIT:      if ((unit_ns = atof(optarg)) <= 0.0) invalid("--unit");
+				      break;
+			case OPT_BACKLOG:   if ((backlog = atoi(optarg)) < 1 || backlog > 32768) invalid("--backlog");
+				      break;
+			case OPT_CPUS:      if (sscanf(optarg, "%d,%d", &cpus[A], &cpus[B]) != 2 || cpus[A] < 0 || cpus[B] < 0)
+					      invalid("--cpus");
+				      break;
+			case OPT_APP_THREAD: app_thread = 1;
+				      break;
+			case OPT_CONSUME:   if ((consume_ns = atof(optarg)) < 0.0) invalid("--consume");
+				      break;
+			default:      display_usage(argv[0]);
+				      exit(-1);
+		}
+	}
+	if (win_size < 1 || nmsgs < 1){
+		fprintf(stderr, "Missing arguments!\n");
+		display_usage(argv[0]);
+		exit(-1);
+	}
+	if (rng == 0)
+		rng = 1;
+}
+
+void pin(int cpu)
+{
+	cpu_set_t set;
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		perror("sched_setaffinity");
+}
+
+/* either side leaving, e.g. in a PANIC, ends the run for the other */
+void shm_exit()
+{
+	atomic_store(&shm->done, 1);
+}
+
+/* initializes one side and waits for the other */
+void start(int AorB)
+{
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	spsc_attach(&tx, &shm->ring[AorB]);
+	spsc_attach(&rx, &shm->ring[1 - AorB]);
+	pin(cpus[AorB]);
+	rng += AorB;
+	/* both, as the simulator does: the modules (e.g. fec) are set up by A_init() */
+	shm_sim->protocol->A_init(shm_sim);
+	shm_sim->protocol->B_init(shm_sim);
+	if (AorB == A){
+		while (atomic_load(&shm->ready) == 0)
+			sched_yield();
+		go_time = now();
+		atomic_store(&shm->go, 1);
+	}
+	else {
+		atomic_store(&shm->ready, 1);
+		while (atomic_load(&shm->go) == 0)
+			sched_yield();
+	}
+}
+
+void run_A()
+{
+	struct sim_state *sim = shm_sim;
+	struct pkt packet;
+	struct msg message;
+	int nsent = 0, idle = 0, busy;
+
+	start(A);
+	while (atomic_load_explicit(&shm->delivered, memory_order_acquire) < nmsgs &&
+			!atomic_load_explicit(&shm->done, memory_order_relaxed)){
+		busy = 0;
+		if (nsent < nmsgs && nsent - atomic_load_explicit(&shm->delivered, memory_order_relaxed) < backlog){
+			memset(message.data, 97 + nsent % 26, PAYLOAD_LEN);
+			sim_time = now();
+			sim->protocol->A_output(sim, message);
+			nsent++;
+		}
+		while (spsc_pop(&rx, &packet, &rx_stamp)){
+			sim_time = now();
+			sim->protocol->A_input(sim, packet);
+			busy = 1;
+		}
+		if (timer_on && (sim_time = now()) >= timer_at){
+			timer_on = 0;
+			sim->protocol->A_timerinterrupt(sim);
+		}
+		/* B has nothing for us: let it run if it shares our CPU */
+		if (busy)
+			idle = 0;
+		else if (++idle > SHM_SPIN){
+			sched_yield();
+			idle = 0;
+		}
+	}
+	atomic_store(&shm->done, 1);
+}
+
+/* B's application taking message app_next */
+void consume(const char *data)
+{
+	int64_t until;
+	int i;
+
+	if (app_next >= nmsgs){
+		printf("PANIC: Unexpected/Non-existent packet!");
+		exit(52);
+	}
+	for (i = 0; i < PAYLOAD_LEN; i++){
+		if (data[i] != 97 + app_next % 26){
+			printf("PANIC: message %d delivered out of order or damaged\n", app_next);
+			exit(63);
+		}
+	}
+	if (consume_ns > 0.0){
+		until = clock_ns() + (int64_t)consume_ns;
+		while (clock_ns() < until)
+			;
+	}
+	app_next++;
+}
+
+/* B's application thread: takes up to APP_BATCH queued messages at a time */
+void *app_main(void *arg)
+{
+	uint32_t tail = 0, head;
+	int n, idle = 0;
+
+	while (!atomic_load_explicit(&shm->done, memory_order_relaxed)){
+		head = atomic_load_explicit(&appq->head, memory_order_acquire);
+		if (head == tail){
+			if (++idle > SHM_SPIN){
+				sched_yield();
+				idle = 0;
+			}
+			continue;
+		}
+		idle = 0;
+		for (n = 0; tail != head && n < APP_BATCH; n++, tail++){
+			consume(appq->slots[tail & (APP_SLOTS - 1)].data);
+		}
+		atomic_store_explicit(&appq->tail, tail, memory_order_release);
+		atomic_store_explicit(&shm->delivered, app_next, memory_order_release);
+	}
+	return NULL;
+}
+
+void run_B()
+{
+	struct sim_state *sim = shm_sim;
+	struct pkt packet;
+	pthread_t app;
+	int idle = 0;
+
+	if (app_thread){
+		if ((appq = aligned_alloc(SPSC_LINE, sizeof(*appq))) == NULL){
+			perror("aligned_alloc");
+			exit(-1);
+		}
+		atomic_init(&appq->head, 0);
+		atomic_init(&appq->tail, 0);
+		app_head = app_tail = 0;
+	}
+	start(B);
+	if (app_thread && pthread_create(&app, NULL, app_main, NULL) != 0){
+		perror("pthread_create");
+		exit(-1);
+	}
+	while (!atomic_load_explicit(&shm->done, memory_order_relaxed)){
+		if (spsc_pop(&rx, &packet, &rx_stamp)){
+			sim_time = now();
+			sim->protocol->B_input(sim, packet);
+			idle = 0;
+		}
+		else if (++idle > SHM_SPIN){
+			sched_yield();
+			idle = 0;
+		}
+	}
+	if (app_thread)
+		pthread_join(app, NULL);
+}
+
+int main(int argc, char **argv)
+{
+	struct shm_side *a, *b;
+	double secs;
+	pid_t pid;
+	int status;
+
+	parse_args(argc, argv);
+	if ((shm_sim = sim_alloc(sim_protocol)) == NULL){
+		perror("calloc");
+		return -1;
+	}
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED){
+		perror("mmap");
+		return -1;
+	}
+	memset(shm, 0, sizeof(*shm));
+	hdr_init(&shm->turnaround);
+	spsc_init(&shm->ring[A]);
+	spsc_init(&shm->ring[B]);
+
+	atexit(shm_exit);
+	fflush(stdout);
+	if ((pid = fork()) < 0){
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0){
+		run_B();
+		_exit(0);
+	}
+	run_A();
+	secs = (now() - go_time) * unit_ns / 1e9;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)){
+		fprintf(stderr, "B did not exit\n");
+		return -1;
+	}
+	if (WEXITSTATUS(status) != 0)
+		return WEXITSTATUS(status);
+
+	a = &shm->side[A];
+	b = &shm->side[B];
+	printf(" Shared-memory transport: %d messages in %f s, %f messages/s\n", nmsgs, secs, nmsgs / secs);
+	printf(" %ld packets from A and %ld from B, %f packets/s; %ld retransmissions\n",
+			a->packets, b->packets, (a->packets + b->packets) / secs, a->retransmits);
+	printf(" %ld packets dropped at a full ring, %ld lost, %ld corrupted\n",
+			a->drops + b->drops, a->lost + b->lost, a->corrupted + b->corrupted);
+	printf(" ACK turnaround (ns): p50 %llu p99 %llu max %llu; delivery %s, %.0f ns per message\n",
+			(unsigned long long)hdr_percentile(&shm->turnaround, 50),
+			(unsigned long long)hdr_percentile(&shm->turnaround, 99),
+			(unsigned long long)hdr_percentile(&shm->turnaround, 100),
+			app_thread ? "on an application thread" : "inline", consume_ns);
+	return 0;
+}
+
+/*************************** SIMULATOR API ***************************/
+
+void tolayer3(struct sim_state *sim, int AorB, struct pkt packet)
+{
+	struct shm_side *side = &shm->side[AorB];
+
+	side->packets++;
+	if (lossprob > 0.0 && shm_rand() < lossprob){
+		side->lost++;
+		return;
+	}
+	if (corruptprob > 0.0 && shm_rand() < corruptprob){
+		side->corrupted++;
+		packet.payload[0] = 'Z';
+	}
+	if (AorB == B)
+		hdr_record(&shm->turnaround, clock_ns() - rx_stamp);
+	if (!spsc_push(&tx, &packet, AorB == A ? clock_ns() : 0))
+		side->drops++;
+}
+
+void tolayer5(struct sim_state *sim, int AorB, char datasent[])
+{
+	if (!app_thread){
+		consume(datasent);
+		atomic_store_explicit(&shm->delivered, app_next, memory_order_release);
+		return;
+	}
+	/* O(1) on the receive path: waits only if the application is APP_SLOTS behind */
+	while (app_head - app_tail == APP_SLOTS){
+		if ((app_tail = atomic_load_explicit(&appq->tail, memory_order_acquire)) + APP_SLOTS == app_head)
+			sched_yield();
+	}
+	memcpy(appq->slots[app_head & (APP_SLOTS - 1)].data, datasent, PAYLOAD_LEN);
+	atomic_store_explicit(&appq->head, ++app_head, memory_order_release);
+}
+
+/* only A's timer ever goes off, as in the simulator */
+void starttimer(struct sim_state *sim, int AorB, float increment)
+{
+	if (AorB != A)
+		return;
+	if (timer_on){
+		printf("Warning: attempt to start a timer that is already started\n");
+		return;
+	}
+	timer_on = 1;
+	timer_at = sim_time + increment;
+}
+
+void stoptimer(struct sim_state *sim, int AorB)
+{
+	if (AorB != A)
+		return;
+	if (!timer_on)
+		printf("Warning: unable to cancel your timer. It wasn't running.\n");
+	timer_on = 0;
+}
+
+double get_sim_time(struct sim_state *sim)
+{
+	return sim_time;
+}
+
+int64_t get_sim_ticks(struct sim_state *sim)
+{
+	return (int64_t)llround(sim_time * SIM_TICKS);
+}
+
+int getwinsize(struct sim_state *sim)
+{
+	return win_size;
+}
+
+int getccmode(struct sim_state *sim)
+{
+	return cc_algo;
+}
+
+float getpacerate(struct sim_state *sim)
+{
+	return pace_rate;
+}
+
+int getfeck(struct sim_state *sim)
+{
+	return fec_block;
+}
+
+int getfecm(struct sim_state *sim)
+{
+	return fec_parity;
+}
+
+int getharq(struct sim_state *sim)
+{
+	return harq;
+}
+
+float gettimeout(struct sim_state *sim)
+{
+	return timeout;
+}
+
+/* B's application takes messages as they come: no receive buffer to advertise */
+int getrcvbuf(struct sim_state *sim)
+{
+	return 0;
+}
+
+int getrcvfree(struct sim_state *sim)
+{
+	return 0;
+}
+
+/* NAKs need B's timer, and only A's goes off here */
+int getnak(struct sim_state *sim)
+{
+	return 0;
+}
+
+/* a PANIC in the protocol ends the process, as in the simulator */
+void sim_exit(struct sim_state *sim, int code)
+{
+	exit(code);
+}
+
+/* no snapshots or branches here */
+void register_state(struct sim_state *sim, void *ptr, size_t size)
+{
+}
+
+void register_reload(struct sim_state *sim, void (*fn)(struct sim_state *sim))
+{
+}
+
+void report_window(struct sim_state *sim, int AorB, int inflight)
+{
+}
+
+void report_retransmit(struct sim_state *sim, int AorB)
+{
+	shm->side[AorB].retransmits++;
+}
+
+void report_probe(struct sim_state *sim, int AorB)
+{
+}
+
+void report_nak(struct sim_state *sim, int AorB)
+{
+}
+
+void report_send(struct sim_state *sim, int AorB)
+{
+}
+
+/* A's backlog is bounded by --backlog instead */
+void report_backlog(struct sim_state *sim, int AorB, int queued)
+{
+}
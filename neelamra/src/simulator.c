@@ -3,16 +3,16 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
 
-#include "../include/simulator.h"
-
-/* Statistics */
-int A_application = 0;
-int A_transport = 0;
-int B_application = 0;
-int B_transport = 0;
-
-int win_size;
+#include "../include/sim.h"
+#include "../include/proto.h"
 
 /*****************************************************************
  ***************** NETWORK EMULATION CODE STARTS BELOW ***********
@@ -28,29 +28,58 @@ int win_size;
  OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
  the emulator, you're welcome to look at the code - but again, you should have
  to, and you defeinitely should not have to modify
+
+ The state of a simulation is in struct sim_state (sim.h), which every
+ routine below is passed; see sim_defaults() for its initial values.
  ******************************************************************/
 
+/* simulated time is kept in ticks (SIM_TICKS per time unit, see simulator.h) */
+#define TICKS(t) ((int64_t)llround((double)(t) * SIM_TICKS))
+#define TICKS_TIME(k) ((double)(k) / SIM_TICKS)
+
 struct event {
-	float evtime;           /* event time */
+	int64_t evtime;         /* event time, in ticks */
 	int evtype;             /* event type code */
 	int eventity;           /* entity where event occurs */
 	struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
 	struct event *prev;
 	struct event *next;
 };
-struct event *evlist = NULL;   /* the event list */
 
-/* msg_track */
-struct msg_track {
-	char msg_chars[20];
-	int delivered;
-}application_msgs[1000];
-int cur_msg_sent = 0, cur_msg_recv = 0;
+#define TRACKED(n) sim->application_msgs[(n) % MSG_TRACK_SIZE]
+#define SNDQ(n) sim->sndq_time[(n) % SNDQ_SIZE]
+
+#define RUN_EVENTS_PER_MSG 200   /* default --max-events per message with --sndbuf or --complete */
+
+/* per-message latency, from A_output() to tolayer5(), in 1/LAT_SCALE time units */
+#define LAT_SCALE 1000.0
 
 //forward declarations
-void init();
-void generate_next_arrival();
-void insertevent(struct event*);
+void init(struct sim_state *sim, int seed);
+int simulate(struct sim_state *sim);
+void write_sample_header(struct sim_state *sim, FILE *fp);
+void write_sample(struct sim_state *sim, FILE *fp);
+void write_json_string(FILE *fp, const char *s);
+void write_summary_json(struct sim_state *sim, FILE *fp);
+void write_summary_csv(struct sim_state *sim, FILE *fp);
+int write_summary(struct sim_state *sim, char *file, void (*writer)(struct sim_state *, FILE *));
+int save_snapshot(struct sim_state *sim, char *file);
+int restore_snapshot(struct sim_state *sim, char *file);
+void branch(struct sim_state *sim);
+void write_branch_result(struct sim_state *sim, int fd);
+void print_branches(struct sim_state *sim);
+int monte_carlo(struct sim_state *sim);
+int tune(struct sim_state *sim);
+int check_msg(struct sim_state *sim, int n, const char *data, int len);
+float jimsrand(struct sim_state *sim);
+void generate_next_arrival(struct sim_state *sim);
+void insertevent(struct sim_state *sim, struct event*);
+void sim_srand(struct sim_state *sim, unsigned int seed);
+void wire_roundtrip(struct sim_state *sim, int AorB, struct pkt *packet);
+void rcv_drain(struct sim_state *sim);
+int sndbuf_need(struct sim_state *sim);
+void give_A(struct sim_state *sim, struct msg message);
+void set_time(struct sim_state *sim, int64_t ticks);
 
 /* possible events: */
 #define  TIMER_INTERRUPT 0
@@ -62,17 +91,74 @@ void insertevent(struct event*);
 #define   A    0
 #define   B    1
 
-int TRACE = 1;             /* for my debugging */
-int nsim = 0;              /* number of messages from 5 to 4 so far */
-int nsimmax = 0;           /* number of msgs to generate, then stop */
-float time = 0.000;
-float lossprob = 0.0;       /* probability that a packet is dropped */
-float corruptprob = 0.0;   /* probability that one bit is packet is flipped */
-float lambda = 0.0;        /* arrival rate of messages from layer 5 */
-int ntolayer3 = 0;        /* number sent into layer 3 */
-int nlost = 0;              /* number lost in media */
-int ncorrupt = 0;        /* number corrupted by media*/
+#define SNAPSHOT_MAGIC "PA2SNAP2"
+
+int parse_variant(char *spec, struct variant *v);
+
+/* Monte Carlo: the same configuration over --seeds seeds, --jobs at a time */
+#define MC_MIN_RUNS 5       /* runs before the CI may stop the experiment */
+
+struct mc_stat {
+	int n;
+	double mean;
+	double m2;              /* sum of squared deviations from the mean */
+};
+
+struct branch_result {
+	double time;
+	double goodput;         /* measured_goodput() */
+	int A_transport;
+	int B_application;
+	int nretrans;
+	float p50;
+	float p99;
+};
+
+/* tuner: successive halving over window and timeout, see tune() */
+#define TUNE_FINAL 8            /* configurations left for the full -m */
+#define TUNE_MIN_MSGS 50        /* fewest messages a rung runs */
+#define TUNE_EVENTS_PER_MSG 1000  /* events per message a run may take before it is given up */
+
+struct tune_cand {
+	int win_size;
+	float timeout;          /* 0 = the protocol's default */
+	int ok;                 /* whether the last run finished */
+	int rank;               /* Pareto rank in its rung, 0 = on the frontier */
+	struct branch_result r;
+};
+
+/* bottleneck link model (disabled while bandwidth is 0) */
+#define  RED_WEIGHT      0.002
+#define  RED_MAXP        0.1
+
+/**
+ * function for setting a simulation to the defaults of the command line
+ *
+ * @param sim Simulation, all zero as sim_alloc() makes it
+ */
+void sim_defaults(sim)
+	struct sim_state *sim;
+{
+	sim->cc_algo = CC_NONE;
+	sim->pace_rate = -1.0;
+	sim->mtu = PAYLOAD_LEN;
+	sim->ss_B_start = -1;
+	sim->done_at = -1.0;
+	sim->TRACE = 1;
+	sim->snapshot_at = -1.0;
+	sim->branch_at = -1.0;
+	sim->branch_fd = -1;
+	sim->tune_win[0] = 1;
+	sim->tune_win[1] = 256;
+	sim->tune_timeout[0] = 5.0;
+	sim->tune_timeout[1] = 200.0;
+	sim->max_events = -1;
+	sim->propdelay = 5.0;
+	sim->qlimit = 50;
+	sim->qdisc = QDISC_FIFO;
+}
 
+#ifndef RELIABLE_LIB
 /**
  * Checks if the array pointed to by input holds a valid number.
  *
@@ -110,25 +196,124 @@ float read_arg_float(char c)
 	return val;
 }
 
-void display_usage(char *filename)
+float read_arg_positive(const char *name)
 {
-	printf("Usage:\n %s -s Seed -w Window size -m Number of messages to simulate -l Loss -c Corruption -t Average time between messages from sender's layer5 -v Tracing\n", filename);
+	float val = atof(optarg);
+	if(val < 0.0){
+		fprintf(stderr, "Invalid value for --%s\n", name);
+		exit(-1);
+	}
+	return val;
 }
 
-int main(int argc, char **argv)
+void display_usage(char *filename)
 {
-	struct event *eventptr;
-	struct msg  msg2give;
-	struct pkt  pkt2give;
+	printf("Usage:\n %s -s Seed -w Window size -m Number of messages to simulate -l Loss -c Corruption -t Average time between messages from sender's layer5 -v Tracing\n", filename);
+	printf("Link model:\n --bandwidth Packets per time unit (0 = legacy channel) --delay Propagation delay --queue Queue capacity in packets --qdisc fifo|red\n");
+	printf("Output:\n --json File for a JSON summary --csv File for a CSV summary --samples File for a CSV time series --sample-interval Simulated time between samples\n");
+	printf("Snapshots:\n --snapshot File to save the state to --snapshot-at Simulated time to save it at --restore File to resume from\n");
+	printf("What-if:\n --branch-at Simulated time to fork the variants at --variant window=W,timeout=T,loss=L,corrupt=C Parameters of one branch (repeatable)\n");
+	printf("Tuning:\n --tune N Search window and timeout from N configurations by successive halving --tune-window LO:HI Windows to search --tune-timeout LO:HI Timeouts to search\n");
+	printf("Monte Carlo:\n --seeds Number of seeds to run from -s on --jobs Runs at a time --ci-width Relative width of the 95%% CIs to stop at\n");
+	printf("Messages:\n --msg-size Bytes per application message, segmented by the simulator --mtu Bytes of each packet payload the segments use --wire Carry packets in the compact wire format and report the bytes they take\n");
+	printf("Sender buffer:\n --sndbuf Packets A may buffer before layer 5 waits for room\n");
+	printf("Limits:\n --max-events Events to simulate before giving up on a run (0 = no limit; with --sndbuf or --complete without T, %d per message by default)\n", RUN_EVENTS_PER_MSG);
+	printf("Measurement:\n --warmup Simulated time whose deliveries the steady-state figures leave out --complete[=T] Run until B has delivered every message, for at most T time units past the last one from layer 5\n");
+	printf("Receiver:\n --rcvbuf Packets B's receive buffer holds --drain Packets per time unit B's application reads from it --nak Report holes to A in NAKs (gbn, sr)\n");
+	printf("Sender:\n --timeout Retransmission timeout --cc none|aimd|cubic Congestion control of the gbn/sr window --pace Pace at window/SRTT --pace-rate Pace at packets per time unit --fec K:M Send M parity packets per K data packets --harq Adapt the parity per block to the loss seen in ACKs (sr)\n");
+}
 
-	int i,j;
-	char c;
+/* long options, returned by getopt_long() as the values below */
+#define  OPT_BANDWIDTH   256
+#define  OPT_DELAY       257
+#define  OPT_QUEUE       258
+#define  OPT_QDISC       259
+#define  OPT_CC          260
+#define  OPT_PACE        261
+#define  OPT_PACE_RATE   262
+#define  OPT_FEC         263
+#define  OPT_HARQ        264
+#define  OPT_JSON        265
+#define  OPT_CSV         266
+#define  OPT_SAMPLES     267
+#define  OPT_SAMPLE_INT  268
+#define  OPT_SNAPSHOT    269
+#define  OPT_SNAPSHOT_AT 270
+#define  OPT_RESTORE     271
+#define  OPT_TIMEOUT     272
+#define  OPT_BRANCH_AT   273
+#define  OPT_VARIANT     274
+#define  OPT_SEEDS       275
+#define  OPT_JOBS        276
+#define  OPT_CI_WIDTH    277
+#define  OPT_MSG_SIZE    278
+#define  OPT_MTU         279
+#define  OPT_WIRE        280
+#define  OPT_RCVBUF      281
+#define  OPT_DRAIN       282
+#define  OPT_SNDBUF      283
+#define  OPT_MAX_EVENTS  284
+#define  OPT_TUNE        285
+#define  OPT_TUNE_WIN    286
+#define  OPT_TUNE_TO     287
+#define  OPT_NAK         288
+#define  OPT_WARMUP      289
+#define  OPT_COMPLETE    290
+
+static struct option long_options[] = {
+	{"bandwidth", required_argument, 0, OPT_BANDWIDTH},
+	{"delay",     required_argument, 0, OPT_DELAY},
+	{"queue",     required_argument, 0, OPT_QUEUE},
+	{"qdisc",     required_argument, 0, OPT_QDISC},
+	{"cc",        required_argument, 0, OPT_CC},
+	{"pace",      no_argument,       0, OPT_PACE},
+	{"pace-rate", required_argument, 0, OPT_PACE_RATE},
+	{"fec",       required_argument, 0, OPT_FEC},
+	{"harq",      no_argument,       0, OPT_HARQ},
+	{"json",      required_argument, 0, OPT_JSON},
+	{"csv",       required_argument, 0, OPT_CSV},
+	{"samples",   required_argument, 0, OPT_SAMPLES},
+	{"sample-interval", required_argument, 0, OPT_SAMPLE_INT},
+	{"snapshot",  required_argument, 0, OPT_SNAPSHOT},
+	{"snapshot-at", required_argument, 0, OPT_SNAPSHOT_AT},
+	{"restore",   required_argument, 0, OPT_RESTORE},
+	{"timeout",   required_argument, 0, OPT_TIMEOUT},
+	{"branch-at", required_argument, 0, OPT_BRANCH_AT},
+	{"variant",   required_argument, 0, OPT_VARIANT},
+	{"seeds",     required_argument, 0, OPT_SEEDS},
+	{"jobs",      required_argument, 0, OPT_JOBS},
+	{"ci-width",  required_argument, 0, OPT_CI_WIDTH},
+	{"msg-size",  required_argument, 0, OPT_MSG_SIZE},
+	{"mtu",       required_argument, 0, OPT_MTU},
+	{"wire",      no_argument,       0, OPT_WIRE},
+	{"rcvbuf",    required_argument, 0, OPT_RCVBUF},
+	{"drain",     required_argument, 0, OPT_DRAIN},
+	{"sndbuf",    required_argument, 0, OPT_SNDBUF},
+	{"max-events", required_argument, 0, OPT_MAX_EVENTS},
+	{"tune",      required_argument, 0, OPT_TUNE},
+	{"tune-window", required_argument, 0, OPT_TUNE_WIN},
+	{"tune-timeout", required_argument, 0, OPT_TUNE_TO},
+	{"nak",       no_argument,       0, OPT_NAK},
+	{"warmup",    required_argument, 0, OPT_WARMUP},
+	{"complete",  optional_argument, 0, OPT_COMPLETE},
+	{0, 0, 0, 0}
+};
 
+/**
+ * function for running the simulator on its command line
+ *
+ * @param sim Simulation, with sim_defaults() applied
+ * @return The program's exit status
+ */
+int sim_main(sim, argc, argv)
+	struct sim_state *sim;
+	int argc;
+	char **argv;
+{
 	int opt;
-	int seed;
 
 	//Check for number of arguments
-	if(argc != 15){
+	if(argc < 15){
 		fprintf(stderr, "Missing arguments!\n");
 		display_usage(argv[0]);
 		return -1;
@@ -138,24 +323,175 @@ int main(int argc, char **argv)
 	 * Parse the arguments
 	 * http://www.gnu.org/software/libc/manual/html_node/Example-of-Getopt.html
 	 */
-	while((opt = getopt(argc, argv,"s:w:m:l:c:t:v:")) != -1){
+	while((opt = getopt_long(argc, argv,"s:w:m:l:c:t:v:", long_options, NULL)) != -1){
 		switch (opt){
-			case 's':   seed = read_arg_int(opt);
+			case 's':   sim->seed = read_arg_int(opt);
 				    break;
-			case 'w':   win_size = read_arg_int(opt);
+			case 'w':   sim->win_size = read_arg_int(opt);
+				    if (sim->win_size > PROTO_RING) {
+					    fprintf(stderr, "-w may be at most %d, the packets the protocols buffer\n", PROTO_RING);
+					    exit(-1);
+				    }
 				    break;
-			case 'm':     nsimmax = read_arg_int(opt);
+			case 'm':     sim->nsimmax = read_arg_int(opt);
 				      break;
-			case 'l':     lossprob = read_arg_float(opt);
+			case 'l':     sim->lossprob = read_arg_float(opt);
 				      break;
-			case 'c':     corruptprob = read_arg_float(opt);
+			case 'c':     sim->corruptprob = read_arg_float(opt);
 				      break;
-			case 't':     if((lambda = atof(optarg)) <= 0.0){
+			case 't':     if((sim->lambda = atof(optarg)) <= 0.0){
 					      fprintf(stderr, "Invalid value for -%c\n", opt);
 					      exit(-1);
 				      }
 				      break;
-			case 'v':     TRACE = read_arg_int(opt);
+			case 'v':     sim->TRACE = read_arg_int(opt);
+				      break;
+			case OPT_BANDWIDTH: sim->bandwidth = read_arg_positive("bandwidth");
+				      break;
+			case OPT_DELAY:     sim->propdelay = read_arg_positive("delay");
+				      break;
+			case OPT_QUEUE:     if(!isNumber(optarg) || (sim->qlimit = atoi(optarg)) < 1){
+					      fprintf(stderr, "Invalid value for --queue\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_QDISC:     if(strcmp(optarg, "fifo") == 0)
+					      sim->qdisc = QDISC_FIFO;
+				      else if(strcmp(optarg, "red") == 0)
+					      sim->qdisc = QDISC_RED;
+				      else {
+					      fprintf(stderr, "Invalid value for --qdisc\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_CC:        if(strcmp(optarg, "none") == 0)
+					      sim->cc_algo = CC_NONE;
+				      else if(strcmp(optarg, "aimd") == 0)
+					      sim->cc_algo = CC_AIMD;
+				      else if(strcmp(optarg, "cubic") == 0)
+					      sim->cc_algo = CC_CUBIC;
+				      else {
+					      fprintf(stderr, "Invalid value for --cc\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_PACE:      sim->pace_rate = 0.0;
+				      break;
+			case OPT_PACE_RATE: if((sim->pace_rate = atof(optarg)) <= 0.0){
+					      fprintf(stderr, "Invalid value for --pace-rate\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_FEC:       if(sscanf(optarg, "%d:%d", &sim->fec_block, &sim->fec_parity) != 2 ||
+					      sim->fec_block < 1 || sim->fec_block > 32 || sim->fec_parity < 0 || sim->fec_parity > 8){
+					      fprintf(stderr, "Invalid value for --fec\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_HARQ:      sim->harq = 1;
+				      break;
+			case OPT_NAK:       sim->use_nak = 1;
+				      break;
+			case OPT_WARMUP:    sim->warmup = read_arg_positive("warmup");
+				      break;
+			case OPT_COMPLETE:  sim->complete = 1;
+				      if (optarg != NULL)
+					      sim->complete_limit = read_arg_positive("complete");
+				      break;
+			case OPT_JSON:      sim->json_file = optarg;
+				      break;
+			case OPT_CSV:       sim->csv_file = optarg;
+				      break;
+			case OPT_SAMPLES:   sim->samples_file = optarg;
+				      break;
+			case OPT_SAMPLE_INT: if((sim->sample_interval = atof(optarg)) <= 0.0){
+					      fprintf(stderr, "Invalid value for --sample-interval\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_SNAPSHOT:  sim->snapshot_file = optarg;
+				      break;
+			case OPT_SNAPSHOT_AT: sim->snapshot_at = read_arg_positive("snapshot-at");
+				      break;
+			case OPT_RESTORE:   sim->restore_file = optarg;
+				      break;
+			case OPT_TIMEOUT:   if((sim->timeout = atof(optarg)) <= 0.0){
+					      fprintf(stderr, "Invalid value for --timeout\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_BRANCH_AT: sim->branch_at = read_arg_positive("branch-at");
+				      break;
+			case OPT_VARIANT:   if(sim->nvariants == MAX_VARIANTS ||
+					      parse_variant(optarg, &sim->variants[sim->nvariants]) < 0){
+					      fprintf(stderr, "Invalid value for --variant\n");
+					      exit(-1);
+				      }
+				      sim->nvariants++;
+				      break;
+			case OPT_SEEDS:     if(!isNumber(optarg) || (sim->nseeds = atoi(optarg)) < 2){
+					      fprintf(stderr, "Invalid value for --seeds\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_JOBS:      if(!isNumber(optarg) || (sim->njobs = atoi(optarg)) < 1){
+					      fprintf(stderr, "Invalid value for --jobs\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_CI_WIDTH:  sim->ci_width = read_arg_positive("ci-width");
+				      break;
+			case OPT_MSG_SIZE:  if(!isNumber(optarg) || (sim->msg_size = atoi(optarg)) < 1 ||
+					      sim->msg_size > SEG_MAXMSG){
+					      fprintf(stderr, "Invalid value for --msg-size\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_MTU:       if(!isNumber(optarg) || (sim->mtu = atoi(optarg)) <= SEG_HDR_LEN ||
+					      sim->mtu > PAYLOAD_LEN){
+					      fprintf(stderr, "Invalid value for --mtu\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_WIRE:      sim->wire = 1;
+				      break;
+			case OPT_RCVBUF:    if(!isNumber(optarg) || (sim->rcvbuf = atoi(optarg)) < 1){
+					      fprintf(stderr, "Invalid value for --rcvbuf\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_TUNE:      if(!isNumber(optarg) || (sim->ntune = atoi(optarg)) < 2 || sim->ntune > 1024){
+					      fprintf(stderr, "Invalid value for --tune\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_TUNE_WIN:  if(sscanf(optarg, "%d:%d", &sim->tune_win[0], &sim->tune_win[1]) != 2 ||
+					      sim->tune_win[0] < 1 || sim->tune_win[1] < sim->tune_win[0] || sim->tune_win[1] > PROTO_RING){
+					      fprintf(stderr, "Invalid value for --tune-window\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_TUNE_TO:   if(sscanf(optarg, "%f:%f", &sim->tune_timeout[0], &sim->tune_timeout[1]) != 2 ||
+					      sim->tune_timeout[0] <= 0.0 || sim->tune_timeout[1] < sim->tune_timeout[0]){
+					      fprintf(stderr, "Invalid value for --tune-timeout\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_SNDBUF:    if(!isNumber(optarg) || (sim->sndbuf = atoi(optarg)) < 1 ||
+					      sim->sndbuf > SNDQ_SIZE){
+					      fprintf(stderr, "Invalid value for --sndbuf\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_MAX_EVENTS: if(!isNumber(optarg) || (sim->max_events = atol(optarg)) < 0){
+					      fprintf(stderr, "Invalid value for --max-events\n");
+					      exit(-1);
+				      }
+				      break;
+			case OPT_DRAIN:     if((sim->drain_rate = atof(optarg)) <= 0.0){
+					      fprintf(stderr, "Invalid value for --drain\n");
+					      exit(-1);
+				      }
 				      break;
 			case '?':
 			default:    fprintf(stderr, "Invalid arguments!\n");
@@ -164,19 +500,122 @@ int main(int argc, char **argv)
 		}
 	}
 
-	init(seed);
-	A_init();
-	B_init();
+	sim->progname = argv[0];
+	if (sim->samples_file != NULL) {
+		if (sim->sample_interval <= 0.0) {
+			fprintf(stderr, "--samples needs --sample-interval\n");
+			return -1;
+		}
+		if ((sim->samples_fp = fopen(sim->samples_file, "w")) == NULL) {
+			perror(sim->samples_file);
+			return -1;
+		}
+		write_sample_header(sim, sim->samples_fp);
+		sim->next_sample = sim->sample_interval;
+	}
+
+	if ((sim->snapshot_file == NULL) != (sim->snapshot_at < 0)) {
+		fprintf(stderr, "--snapshot and --snapshot-at go together\n");
+		return -1;
+	}
+	if ((sim->rcvbuf == 0) != (sim->drain_rate <= 0.0)) {
+		fprintf(stderr, "--rcvbuf and --drain go together\n");
+		return -1;
+	}
+	if ((sim->nvariants == 0) != (sim->branch_at < 0)) {
+		fprintf(stderr, "--branch-at and --variant go together\n");
+		return -1;
+	}
+	if (sim->nseeds > 0 && (sim->nvariants > 0 || sim->restore_file != NULL)) {
+		fprintf(stderr, "--seeds cannot be combined with --branch-at or --restore\n");
+		return -1;
+	}
+	/* with --sndbuf layer 5 waits on the protocol, and --complete without a */
+	/* cap waits for the last delivery, so a run whose deliveries stall, as   */
+	/* in a retransmission storm, would never end                             */
+	if (sim->max_events < 0)
+		sim->max_events = sim->sndbuf > 0 || (sim->complete && sim->complete_limit == 0.0) ?
+			(long)sim->nsimmax * RUN_EVENTS_PER_MSG : 0;
+	if (sim->ntune > 0 && (sim->nseeds > 0 || sim->nvariants > 0 || sim->restore_file != NULL)) {
+		fprintf(stderr, "--tune cannot be combined with --seeds, --branch-at or --restore\n");
+		return -1;
+	}
+	if (sim->nseeds > 0 && monte_carlo(sim) == 0)
+		return 0;
+	if (sim->ntune > 0 && tune(sim) == 0)
+		return 0;
+	return simulate(sim);
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_state *sim = sim_alloc(sim_protocol);
+
+	if (sim == NULL) {
+		perror(argv[0]);
+		return -1;
+	}
+	sim_defaults(sim);
+	return sim_main(sim, argc, argv);
+}
+#endif
+
+/**
+ * function for running a simulation to its end, without reporting it
+ *
+ * @return 0 once the run is over, -1 if the configuration cannot run
+ */
+int sim_run(sim)
+	struct sim_state *sim;
+{
+	struct event *eventptr;
+	struct msg  msg2give;
+	struct pkt  pkt2give;
+
+	int i,j;
+
+	init(sim, sim->seed);
+	if (sim->msg_size > 0)
+		seg_init(sim, sim->mtu);
+	if (sim->sndbuf > 0 && sim->sndbuf < sndbuf_need(sim)) {
+		if (sim->TRACE >= 0)
+			fprintf(stderr, "--sndbuf must hold the %d segments of a message\n", sndbuf_need(sim));
+		return -1;
+	}
+	sim->protocol->A_init(sim);
+	sim->protocol->B_init(sim);
+	if (sim->restore_file != NULL && restore_snapshot(sim, sim->restore_file) < 0)
+		return -1;
 
 	while (1) {
-		eventptr = evlist;            /* get next event to simulate */
+		if (sim->snapshot_file != NULL && sim->evlist != NULL && sim->evlist->evtime >= TICKS(sim->snapshot_at)) {
+			if (save_snapshot(sim, sim->snapshot_file) < 0)
+				return -1;
+			sim->snapshot_file = NULL;
+		}
+#ifndef RELIABLE_LIB
+		if (sim->branch_at >= 0 && sim->evlist != NULL && sim->evlist->evtime >= TICKS(sim->branch_at)) {
+			branch(sim);
+			sim->branch_at = -1.0;
+		}
+#endif
+		eventptr = sim->evlist;            /* get next event to simulate */
 		if (eventptr==NULL)
-			goto terminate;
-		evlist = evlist->next;        /* remove this event from event list */
-		if (evlist!=NULL)
-			evlist->prev=NULL;
-		if (TRACE>=2) {
-			printf("\nEVENT time: %f,",eventptr->evtime);
+			break;
+		sim->evlist = sim->evlist->next;        /* remove this event from event list */
+		if (sim->evlist!=NULL)
+			sim->evlist->prev=NULL;
+		sim->cur_event = eventptr;         /* for whoever catches a sim_exit() to free */
+		sim->nevents++;
+		if (sim->max_events > 0 && sim->nevents > sim->max_events) {
+			if (sim->branch_fd < 0 && sim->TRACE >= 0)
+				fprintf(stderr, "Gave up after %ld events at time %f, with %d of %d messages from layer 5 "
+					"and %d delivered: raise --max-events, or pass 0 for no limit\n",
+					sim->max_events, sim->time, sim->nsim, sim->nsimmax, sim->cur_msg_recv);
+			sim_exit(sim, 59);
+		}
+		if (sim->TRACE>=2) {
+			printf("\nEVENT time: %f,",TICKS_TIME(eventptr->evtime));
 			printf("  type: %d",eventptr->evtype);
 			if (eventptr->evtype==0)
 				printf(", timerinterrupt  ");
@@ -186,31 +625,71 @@ int main(int argc, char **argv)
 				printf(", fromlayer3 ");
 			printf(" entity: %d\n",eventptr->eventity);
 		}
-		time = eventptr->evtime;        /* update time to next event time */
-		if (nsim==nsimmax)
+		while (sim->samples_fp != NULL && TICKS(sim->next_sample) <= eventptr->evtime) {
+			set_time(sim, TICKS(sim->next_sample));
+			write_sample(sim, sim->samples_fp);
+			sim->next_sample += sim->sample_interval;
+		}
+		if (sim->ss_B_start < 0 && TICKS(sim->warmup) <= eventptr->evtime)
+			sim->ss_B_start = sim->B_application;   /* the warm-up is over */
+		set_time(sim, eventptr->evtime);     /* update time to next event time */
+		if (sim->nsim==sim->nsimmax && (!sim->complete || (sim->complete_limit > 0.0 && sim->time > sim->ss_end + sim->complete_limit))) {
+			if (eventptr->evtype == FROM_LAYER3)
+				free(eventptr->pktptr);
+			free(eventptr);
+			sim->cur_event = NULL;
 			break;                        /* all done with simulation */
-		if (eventptr->evtype == FROM_LAYER5 ) {
-			generate_next_arrival();   /* set up future arrival */
+		}
+		if (eventptr->evtype == FROM_LAYER5 && sim->nsim==sim->nsimmax) {
+			/* --complete: layer 5 is done, the rest of the run drains what A holds */
+		}
+		else if (eventptr->evtype == FROM_LAYER5 && sim->sndbuf > 0 && sim->backlog + sndbuf_need(sim) > sim->sndbuf) {
+			/* A's send buffer is full: layer 5 holds the message back and stops */
+			/* generating more until report_backlog() says there is room again */
+			sim->l5_blocked = 1;
+			sim->l5_blocked_at = sim->time;
+			sim->nblocked++;
+			if (sim->TRACE>2)
+				printf("          MAINLOOP: send buffer full, layer 5 waits\n");
+		}
+		else if (eventptr->evtype == FROM_LAYER5 ) {
+			generate_next_arrival(sim);   /* set up future arrival */
 			/* fill in msg to give with string of same letter */
-			j = nsim % 26;
-			for (i=0; i<20; i++)
+			j = sim->nsim % 26;
+			for (i=0; i<PAYLOAD_LEN; i++)
 				msg2give.data[i] = 97 + j;
-			if (TRACE>2) {
+			if (sim->TRACE>2) {
 				printf("          MAINLOOP: data given to student: ");
-				for (i=0; i<20; i++)
+				for (i=0; i<PAYLOAD_LEN; i++)
 					printf("%c", msg2give.data[i]);
 				printf("\n");
 			}
-			nsim++;
+			sim->nsim++;
+			if (sim->nsim == sim->nsimmax) {
+				sim->ss_end = sim->time;
+				sim->ss_B_end = sim->B_application;
+			}
 			if (eventptr->eventity == A)
 			{
-				A_application += 1;
-
-				memcpy(application_msgs[cur_msg_sent].msg_chars, msg2give.data, 20);
-				application_msgs[cur_msg_sent].delivered = 0;
-				cur_msg_sent += 1;
-
-				A_output(msg2give);
+				if (sim->cur_msg_sent - sim->cur_msg_recv == MSG_TRACK_SIZE) {
+					if (sim->TRACE >= 0)
+						printf("PANIC: more than %d undelivered messages to track!", MSG_TRACK_SIZE);
+					sim_exit(sim, 53);
+				}
+				TRACKED(sim->cur_msg_sent).letter = 97 + j;
+				TRACKED(sim->cur_msg_sent).delivered = 0;
+				TRACKED(sim->cur_msg_sent).sent_time = sim->time;
+				sim->cur_msg_sent += 1;
+
+				if (sim->msg_size > 0) {
+					memset(sim->msgbuf, 97 + j, sim->msg_size);
+					sim->A_application += seg_count(sim, sim->msg_size);
+					seg_output(sim, sim->msgbuf, sim->msg_size, give_A);
+				}
+				else {
+					sim->A_application += 1;
+					give_A(sim, msg2give);
+				}
 			}
 			/*
 			   else
@@ -221,52 +700,143 @@ int main(int argc, char **argv)
 			pkt2give.seqnum = eventptr->pktptr->seqnum;
 			pkt2give.acknum = eventptr->pktptr->acknum;
 			pkt2give.checksum = eventptr->pktptr->checksum;
-			for (i=0; i<20; i++)
+			for (i=0; i<PAYLOAD_LEN; i++)
 				pkt2give.payload[i] = eventptr->pktptr->payload[i];
+			sim->inchannel[eventptr->eventity]--;
 			if (eventptr->eventity ==A)      /* deliver packet by calling */
-				A_input(pkt2give);            /* appropriate entity */
+				sim->protocol->A_input(sim, pkt2give);            /* appropriate entity */
 			else
 			{
-				B_transport += 1;
-				B_input(pkt2give);
+				sim->B_transport += 1;
+				sim->protocol->B_input(sim, pkt2give);
 			}
 			free(eventptr->pktptr);          /* free the memory for packet */
 		}
 		else if (eventptr->evtype ==  TIMER_INTERRUPT) {
 			if (eventptr->eventity == A)
-				A_timerinterrupt();
-			/*
-			   else
-			   B_timerinterrupt();
-			   */
+				sim->protocol->A_timerinterrupt(sim);
+			else
+				sim->protocol->B_timerinterrupt(sim);
 		}
 		else  {
-			printf("INTERNAL PANIC: unknown event type \n");
+			if (sim->TRACE >= 0)
+				printf("INTERNAL PANIC: unknown event type \n");
 		}
 		free(eventptr);
+		sim->cur_event = NULL;
+		if (sim->complete && sim->nsim==sim->nsimmax && sim->cur_msg_recv == sim->cur_msg_sent) {
+			sim->done_at = sim->time;
+			break;                        /* --complete: every message is in */
+		}
 	}
+	return 0;
+}
 
-terminate:
+#ifndef RELIABLE_LIB
+/**
+ * function for running the simulation sim describes and reporting it
+ *
+ * @return 0 once the summary is out, -1 if the configuration cannot run
+ */
+int simulate(sim)
+	struct sim_state *sim;
+{
+	if (sim_run(sim) < 0)
+		return -1;
+	if (sim->branch_fd >= 0) {
+		write_branch_result(sim, sim->branch_fd);
+		return 0;
+	}
 	//Do NOT change any of the following printfs
-	printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",time,nsim);
+	printf(" Simulator terminated at time %f\n after sending %d msgs from layer5\n",sim->time,sim->nsim);
 
 	printf("\n");
-	printf("[PA2]%d packets sent from the Application Layer of Sender A[/PA2]\n", A_application);
-	printf("[PA2]%d packets sent from the Transport Layer of Sender A[/PA2]\n", A_transport);
-	printf("[PA2]%d packets received at the Transport layer of Receiver B[/PA2]\n", B_transport);
-	printf("[PA2]%d packets received at the Application layer of Receiver B[/PA2]\n", B_application);
-	printf("[PA2]Total time: %f time units[/PA2]\n", time);
-	printf("[PA2]Throughput: %f packets/time units[/PA2]\n", B_application/time);
+	printf("[PA2]%d packets sent from the Application Layer of Sender A[/PA2]\n", sim->A_application);
+	printf("[PA2]%d packets sent from the Transport Layer of Sender A[/PA2]\n", sim->A_transport);
+	printf("[PA2]%d packets received at the Transport layer of Receiver B[/PA2]\n", sim->B_transport);
+	printf("[PA2]%d packets received at the Application layer of Receiver B[/PA2]\n", sim->B_application);
+	printf("[PA2]Total time: %f time units[/PA2]\n", sim->time);
+	printf("[PA2]Throughput: %f packets/time units[/PA2]\n", sim->B_application/sim->time);
+	if (sim->bandwidth > 0.0) {
+		printf("\n");
+		printf(" Bottleneck link: %f packets/time unit, delay %f, %s queue of %d packets\n",
+				sim->bandwidth, sim->propdelay, sim->qdisc == QDISC_RED ? "RED" : "FIFO", sim->qlimit);
+		printf(" %d packets dropped at the bottleneck queue, max queue depth %d\n", sim->nqdrop, sim->maxqdepth);
+	}
+	if (sim->latency.total > 0) {
+		printf("\n");
+		printf(" Latency (time units): p50 %f p90 %f p99 %f p99.9 %f max %f\n",
+				latency_at(&sim->latency, 50), latency_at(&sim->latency, 90), latency_at(&sim->latency, 99),
+				latency_at(&sim->latency, 99.9), latency_at(&sim->latency, 100));
+	}
+	if (sim->msg_size > 0) {
+		printf("\n");
+		printf(" %d messages of %d bytes delivered in %d-byte segments: %f bytes/time unit\n",
+				sim->cur_msg_recv, sim->msg_size, sim->mtu, sim->bytes_delivered/sim->time);
+	}
+	if (sim->wire) {
+		printf("\n");
+		printf(" Bytes on the wire per delivered message: %f as struct pkt, %f compact\n",
+				sim->cur_msg_recv > 0 ? (double)sim->raw_bytes/sim->cur_msg_recv : 0.0,
+				sim->cur_msg_recv > 0 ? (double)sim->wire_bytes/sim->cur_msg_recv : 0.0);
+	}
+	if (sim->sndbuf > 0) {
+		printf("\n");
+		printf(" Send buffer of %d packets: layer 5 waited for room %d times, %f time units in all\n",
+				sim->sndbuf, sim->nblocked, sim->l5_blocked_time + (sim->l5_blocked ? sim->time - sim->l5_blocked_at : 0.0));
+		printf(" Sender queueing delay (time units): p50 %f p99 %f max %f\n",
+				latency_at(&sim->sndq_latency, 50), latency_at(&sim->sndq_latency, 99),
+				latency_at(&sim->sndq_latency, 100));
+	}
+	if (sim->rcvbuf > 0) {
+		printf("\n");
+		printf(" Receive buffer of %d packets read at %f per time unit: max occupancy %d\n",
+				sim->rcvbuf, sim->drain_rate, sim->rcv_maxqueued);
+		printf(" %d retransmissions, %d zero-window probes\n", sim->nretrans, sim->nprobes);
+	}
+	if (sim->use_nak) {
+		printf("\n");
+		printf(" %d NAKs sent by B, %d retransmissions\n", sim->nnaks, sim->nretrans);
+	}
+	if (sim->warmup > 0.0) {
+		printf("\n");
+		if (sim->ss_B_start < 0 || sim->ss_end <= sim->warmup)
+			printf(" No steady state: the warm-up of %f outlasts the messages from layer 5\n", sim->warmup);
+		else {
+			printf(" Steady state from %f to %f: %d packets delivered, %f packets/time unit\n",
+					sim->warmup, sim->ss_end, sim->ss_B_end - sim->ss_B_start, measured_goodput(sim));
+			printf(" Steady-state latency (time units): p50 %f p90 %f p99 %f max %f\n",
+					latency_at(&sim->ss_latency, 50), latency_at(&sim->ss_latency, 90),
+					latency_at(&sim->ss_latency, 99), latency_at(&sim->ss_latency, 100));
+		}
+	}
+	if (sim->complete) {
+		printf("\n");
+		if (sim->done_at >= 0.0)
+			printf(" All %d messages delivered at %f, %f after layer 5 gave the last one\n",
+					sim->cur_msg_recv, sim->done_at, sim->done_at - sim->ss_end);
+		else
+			printf(" %d of %d messages delivered by %f, %f after layer 5 gave the last one\n",
+					sim->cur_msg_recv, sim->nsim, sim->time, sim->time - sim->ss_end);
+	}
+	if (sim->nvariants > 0)
+		print_branches(sim);
+	if (sim->samples_fp != NULL)
+		fclose(sim->samples_fp);
+	if (sim->json_file != NULL && write_summary(sim, sim->json_file, write_summary_json) < 0)
+		return -1;
+	if (sim->csv_file != NULL && write_summary(sim, sim->csv_file, write_summary_csv) < 0)
+		return -1;
 	return 0;
 }
+#endif
 
 
 
-void init(int seed)                         /* initialize the simulator */
+void init(struct sim_state *sim, int seed)                         /* initialize the simulator */
 {
 	int i;
 	float sum, avg;
-	float jimsrand();
 
 	/*
 	   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
@@ -282,24 +852,109 @@ void init(int seed)                         /* initialize the simulator */
 	   scanf("%d",&TRACE);
 	   */
 
-	srand(seed);              /* init random number generator */
+	sim->nstate_regions = 0;
+	sim->nreload_hooks = 0;
+	SAVE_STATE(sim, sim->sim_ticks);
+	SAVE_STATE(sim, sim->time);
+	SAVE_STATE(sim, sim->nsim);
+	SAVE_STATE(sim, sim->A_application);
+	SAVE_STATE(sim, sim->A_transport);
+	SAVE_STATE(sim, sim->B_application);
+	SAVE_STATE(sim, sim->B_transport);
+	SAVE_STATE(sim, sim->ntolayer3);
+	SAVE_STATE(sim, sim->nlost);
+	SAVE_STATE(sim, sim->ncorrupt);
+	SAVE_STATE(sim, sim->nevents);
+	SAVE_STATE(sim, sim->nretrans);
+	SAVE_STATE(sim, sim->winocc);
+	SAVE_STATE(sim, sim->inchannel);
+	SAVE_STATE(sim, sim->link_busy);
+	SAVE_STATE(sim, sim->red_avg);
+	SAVE_STATE(sim, sim->nqdrop);
+	SAVE_STATE(sim, sim->maxqdepth);
+	SAVE_STATE(sim, sim->application_msgs);
+	SAVE_STATE(sim, sim->cur_msg_sent);
+	SAVE_STATE(sim, sim->cur_msg_recv);
+	SAVE_STATE(sim, sim->bytes_delivered);
+	SAVE_STATE(sim, sim->raw_bytes);
+	SAVE_STATE(sim, sim->wire_bytes);
+	SAVE_STATE(sim, sim->wire_tx);
+	SAVE_STATE(sim, sim->wire_rx);
+	SAVE_STATE(sim, sim->rcv_queued);
+	SAVE_STATE(sim, sim->rcv_read);
+	SAVE_STATE(sim, sim->rcv_maxqueued);
+	SAVE_STATE(sim, sim->nprobes);
+	SAVE_STATE(sim, sim->nnaks);
+	SAVE_STATE(sim, sim->backlog);
+	SAVE_STATE(sim, sim->l5_blocked);
+	SAVE_STATE(sim, sim->l5_blocked_at);
+	SAVE_STATE(sim, sim->l5_blocked_time);
+	SAVE_STATE(sim, sim->nblocked);
+	SAVE_STATE(sim, sim->sndq_time);
+	SAVE_STATE(sim, sim->sndq_in);
+	SAVE_STATE(sim, sim->sndq_out);
+	SAVE_STATE(sim, sim->sndq_latency);
+	SAVE_STATE(sim, sim->latency);
+	SAVE_STATE(sim, sim->sample_latency);
+	SAVE_STATE(sim, sim->next_sample);
+	SAVE_STATE(sim, sim->sample_A_transport);
+	SAVE_STATE(sim, sim->sample_B_application);
+	SAVE_STATE(sim, sim->ss_B_start);
+	SAVE_STATE(sim, sim->ss_B_end);
+	SAVE_STATE(sim, sim->ss_end);
+	SAVE_STATE(sim, sim->done_at);
+	SAVE_STATE(sim, sim->ss_latency);
+
+	sim_srand(sim, seed);          /* init random number generator */
 	sum = 0.0;                /* test random number generator for students */
 	for (i=0; i<1000; i++)
-		sum=sum+jimsrand();    /* jimsrand() should be uniform in [0,1] */
+		sum=sum+jimsrand(sim);    /* jimsrand() should be uniform in [0,1] */
 	avg = sum/1000.0;
 	if (avg < 0.25 || avg > 0.75) {
-		printf("It is likely that random number generation on your machine\n" );
-		printf("is different from what this emulator expects.  Please take\n");
-		printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-		exit(0);
+		if (sim->TRACE >= 0) {
+			printf("It is likely that random number generation on your machine\n" );
+			printf("is different from what this emulator expects.  Please take\n");
+			printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+		}
+		sim_exit(sim, 0);
 	}
 
-	ntolayer3 = 0;
-	nlost = 0;
-	ncorrupt = 0;
+	sim->ntolayer3 = 0;
+	sim->nlost = 0;
+	sim->ncorrupt = 0;
+	sim->nretrans = 0;
+	hdr_init(&sim->latency);
+	hdr_init(&sim->sample_latency);
+	sim->winocc[A] = sim->winocc[B] = 0;
+	sim->inchannel[A] = sim->inchannel[B] = 0;
+	sim->nqdrop = 0;
+	sim->maxqdepth = 0;
+	sim->link_busy[A] = sim->link_busy[B] = 0.0;
+	sim->red_avg[A] = sim->red_avg[B] = 0.0;
+	sim->raw_bytes = sim->wire_bytes = 0;
+	sim->rcv_queued = 0;
+	sim->rcv_read = 0.0;
+	sim->rcv_maxqueued = 0;
+	sim->nprobes = 0;
+	sim->nnaks = 0;
+	sim->backlog = 0;
+	sim->l5_blocked = 0;
+	sim->l5_blocked_time = 0.0;
+	sim->nblocked = 0;
+	sim->sndq_in = sim->sndq_out = 0;
+	hdr_init(&sim->sndq_latency);
+	sim->ss_B_start = -1;
+	sim->ss_B_end = 0;
+	sim->ss_end = 0.0;
+	sim->done_at = -1.0;
+	hdr_init(&sim->ss_latency);
+	for (i=0; i<2; i++) {
+		wire_init(&sim->wire_tx[i]);
+		wire_init(&sim->wire_rx[i]);
+	}
 
-	time=0.0;                    /* initialize time to 0.0 */
-	generate_next_arrival();     /* initialize event list */
+	set_time(sim, 0);                 /* initialize time to 0.0 */
+	generate_next_arrival(sim);     /* initialize event list */
 }
 
 /****************************************************************************/
@@ -307,19 +962,820 @@ void init(int seed)                         /* initialize the simulator */
 /* isolate all random number generation in one location.  We assume that the*/
 /* system-supplied rand() function return an int in therange [0,mmm]        */
 /****************************************************************************/
-float jimsrand()
+float jimsrand(sim)
+	struct sim_state *sim;
 {
 	double mmm = 2147483647;   /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
 	float x;                   /* individual students may need to change mmm */
-	x = rand()/mmm;            /* x should be uniform in [0,1] */
+	int32_t r;
+	random_r(&sim->rng, &r);        /* same sequence as rand() after srand(seed) */
+	x = r/mmm;                 /* x should be uniform in [0,1] */
 	return(x);
 }
 
+void sim_srand(sim, seed)
+	struct sim_state *sim;
+	unsigned int seed;
+{
+	memset(&sim->rng, 0, sizeof(sim->rng));
+	initstate_r(seed, sim->rng_state, RNG_STATE_SIZE, &sim->rng);
+}
+
+/********************* MACHINE-READABLE OUTPUT ***********************/
+/* throughput counts every packet A puts into layer 3 (retransmissions */
+/* included); goodput counts messages delivered to B's layer 5 and is  */
+/* the figure the [PA2] Throughput line reports.                       */
+/***********************************************************************/
+
+/* packets waiting at, or being serialized onto, A's bottleneck link */
+int queue_depth(sim)
+	struct sim_state *sim;
+{
+	if (sim->bandwidth <= 0.0 || sim->link_busy[A] <= sim->time)
+		return 0;
+	return (int)ceil((sim->link_busy[A] - sim->time) * sim->bandwidth - 0.001);
+}
+
+/* latency percentile in time units */
+float latency_at(h, percentile)
+	struct hdr_hist *h;
+	double percentile;
+{
+	return hdr_percentile(h, percentile) / LAT_SCALE;
+}
+
+/* goodput in packets per time unit: with --warmup over the steady state, from */
+/* the end of the warm-up to the last message from layer 5, otherwise over the */
+/* whole run as the [PA2] Throughput line has it                               */
+double measured_goodput(sim)
+	struct sim_state *sim;
+{
+	if (sim->warmup <= 0.0)
+		return sim->time > 0 ? sim->B_application/sim->time : 0.0;
+	if (sim->ss_B_start < 0 || sim->ss_end <= sim->warmup)
+		return 0.0;
+	return (sim->ss_B_end - sim->ss_B_start) / (sim->ss_end - sim->warmup);
+}
+
+/* the latencies over the same window */
+struct hdr_hist *measured_latency(sim)
+	struct sim_state *sim;
+{
+	return sim->warmup > 0.0 ? &sim->ss_latency : &sim->latency;
+}
+
+
+void write_sample_header(struct sim_state *sim, FILE *fp)
+{
+	fprintf(fp, "time,throughput,goodput,retransmissions,window,queue,in_channel,lost,corrupted,queue_drops,latency_p50,latency_p99,latency_max\n");
+	sim->sample_A_transport = 0;
+	sim->sample_B_application = 0;
+}
+
+/* one row per interval; rates cover the interval just ended, counts are running totals */
+void write_sample(struct sim_state *sim, FILE *fp)
+{
+	fprintf(fp, "%f,%f,%f,%d,%d,%d,%d,%d,%d,%d,%f,%f,%f\n", sim->time,
+			(sim->A_transport - sim->sample_A_transport) / sim->sample_interval,
+			(sim->B_application - sim->sample_B_application) / sim->sample_interval,
+			sim->nretrans, sim->winocc[A], queue_depth(sim), sim->inchannel[B], sim->nlost, sim->ncorrupt, sim->nqdrop,
+			latency_at(&sim->sample_latency, 50), latency_at(&sim->sample_latency, 99),
+			latency_at(&sim->sample_latency, 100));
+	fflush(fp);
+	hdr_init(&sim->sample_latency);
+	sim->sample_A_transport = sim->A_transport;
+	sim->sample_B_application = sim->B_application;
+}
+
+/* s as a JSON string, quotes included */
+void write_json_string(fp, s)
+	FILE *fp;
+	const char *s;
+{
+	fputc('"', fp);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+void write_summary_json(struct sim_state *sim, FILE *fp)
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"program\": ");
+	write_json_string(fp, sim->progname);
+	fprintf(fp, ",\n");
+	fprintf(fp, "  \"config\": {\"seed\": %d, \"window\": %d, \"messages\": %d, \"loss\": %f, \"corruption\": %f, \"interarrival\": %f,\n", sim->seed, sim->win_size, sim->nsimmax, sim->lossprob, sim->corruptprob, sim->lambda);
+	fprintf(fp, "             \"bandwidth\": %f, \"delay\": %f, \"queue\": %d, \"qdisc\": \"%s\",\n", sim->bandwidth, sim->propdelay, sim->qlimit, sim->qdisc == QDISC_RED ? "red" : "fifo");
+	fprintf(fp, "             \"msg_size\": %d, \"mtu\": %d},\n", sim->msg_size > 0 ? sim->msg_size : PAYLOAD_LEN, sim->mtu);
+	fprintf(fp, "  \"time\": %f,\n", sim->time);
+	fprintf(fp, "  \"events\": %ld,\n", sim->nevents);
+	fprintf(fp, "  \"A_application\": %d,\n", sim->A_application);
+	fprintf(fp, "  \"A_transport\": %d,\n", sim->A_transport);
+	fprintf(fp, "  \"B_transport\": %d,\n", sim->B_transport);
+	fprintf(fp, "  \"B_application\": %d,\n", sim->B_application);
+	fprintf(fp, "  \"retransmissions\": %d,\n", sim->nretrans);
+	fprintf(fp, "  \"lost\": %d,\n", sim->nlost);
+	fprintf(fp, "  \"corrupted\": %d,\n", sim->ncorrupt);
+	fprintf(fp, "  \"queue_drops\": %d,\n", sim->nqdrop);
+	fprintf(fp, "  \"max_queue\": %d,\n", sim->maxqdepth);
+	fprintf(fp, "  \"latency\": {\"p50\": %f, \"p90\": %f, \"p99\": %f, \"p99_9\": %f, \"max\": %f},\n",
+			latency_at(&sim->latency, 50), latency_at(&sim->latency, 90), latency_at(&sim->latency, 99),
+			latency_at(&sim->latency, 99.9), latency_at(&sim->latency, 100));
+	fprintf(fp, "  \"throughput\": %f,\n", sim->time > 0 ? sim->A_transport/sim->time : 0.0);
+	fprintf(fp, "  \"goodput\": %f,\n", sim->time > 0 ? sim->B_application/sim->time : 0.0);
+	fprintf(fp, "  \"bytes_delivered\": %ld,\n", sim->bytes_delivered);
+	fprintf(fp, "  \"goodput_bytes\": %f,\n", sim->time > 0 ? sim->bytes_delivered/sim->time : 0.0);
+	fprintf(fp, "  \"raw_bytes\": %ld,\n", sim->raw_bytes);
+	fprintf(fp, "  \"wire_bytes\": %ld,\n", sim->wire_bytes);
+	fprintf(fp, "  \"warmup\": %f,\n", sim->warmup);
+	fprintf(fp, "  \"steady_goodput\": %f,\n", measured_goodput(sim));
+	fprintf(fp, "  \"steady_latency\": {\"p50\": %f, \"p99\": %f, \"max\": %f},\n",
+			latency_at(measured_latency(sim), 50), latency_at(measured_latency(sim), 99),
+			latency_at(measured_latency(sim), 100));
+	if (sim->done_at >= 0.0)
+		fprintf(fp, "  \"completion_time\": %f\n", sim->done_at);
+	else
+		fprintf(fp, "  \"completion_time\": null\n");
+	fprintf(fp, "}\n");
+}
+
+void write_summary_csv(struct sim_state *sim, FILE *fp)
+{
+	fprintf(fp, "program,seed,window,messages,loss,corruption,interarrival,time,events,A_application,A_transport,B_transport,B_application,retransmissions,lost,corrupted,queue_drops,max_queue,latency_p50,latency_p90,latency_p99,latency_p99_9,latency_max,throughput,goodput,msg_size,bytes_delivered,goodput_bytes,raw_bytes,wire_bytes,warmup,steady_goodput,steady_latency_p50,steady_latency_p99,completion_time\n");
+	fprintf(fp, "%s,%d,%d,%d,%f,%f,%f,%f,%ld,%d,%d,%d,%d,%d,%d,%d,%d,%d,%f,%f,%f,%f,%f,%f,%f,%d,%ld,%f,%ld,%ld,%f,%f,%f,%f,%f\n",
+			sim->progname, sim->seed, sim->win_size, sim->nsimmax, sim->lossprob, sim->corruptprob, sim->lambda, sim->time, sim->nevents,
+			sim->A_application, sim->A_transport, sim->B_transport, sim->B_application, sim->nretrans, sim->nlost, sim->ncorrupt,
+			sim->nqdrop, sim->maxqdepth, latency_at(&sim->latency, 50), latency_at(&sim->latency, 90),
+			latency_at(&sim->latency, 99), latency_at(&sim->latency, 99.9), latency_at(&sim->latency, 100),
+			sim->time > 0 ? sim->A_transport/sim->time : 0.0, sim->time > 0 ? sim->B_application/sim->time : 0.0,
+			sim->msg_size > 0 ? sim->msg_size : PAYLOAD_LEN, sim->bytes_delivered, sim->time > 0 ? sim->bytes_delivered/sim->time : 0.0,
+			sim->raw_bytes, sim->wire_bytes, sim->warmup, measured_goodput(sim), latency_at(measured_latency(sim), 50),
+			latency_at(measured_latency(sim), 99), sim->done_at);
+}
+
+int write_summary(sim, file, writer)
+	struct sim_state *sim;
+	char *file;
+	void (*writer)(struct sim_state *, FILE *);
+{
+	FILE *fp = fopen(file, "w");
+	if (fp == NULL) {
+		perror(file);
+		return -1;
+	}
+	writer(sim, fp);
+	fclose(fp);
+	return 0;
+}
+
+/***************************** SNAPSHOTS ******************************/
+/* A snapshot holds every registered state region, the random number    */
+/* generator and the event list. It is taken before the first event at */
+/* or after --snapshot-at, and --restore resumes from it after the      */
+/* usual init(), so the run continues with its own command line.        */
+/* Snapshots are only valid for the binary that wrote them.             */
+/***********************************************************************/
+
+struct snapshot_event {
+	int64_t evtime;
+	int evtype;
+	int eventity;
+	int haspkt;
+	struct pkt pkt;
+};
+
+int save_snapshot(sim, file)
+	struct sim_state *sim;
+	char *file;
+{
+	FILE *fp;
+	struct event *q;
+	struct snapshot_event sev;
+	long off[2];
+	int i, nev = 0;
+
+	if ((fp = fopen(file, "wb")) == NULL) {
+		perror(file);
+		return -1;
+	}
+	for (q = sim->evlist; q != NULL; q = q->next)
+		nev++;
+	fwrite(SNAPSHOT_MAGIC, 1, 8, fp);
+	fwrite(&sim->nstate_regions, sizeof(int), 1, fp);
+	for (i = 0; i < sim->nstate_regions; i++)
+		fwrite(&sim->state_regions[i].size, sizeof(size_t), 1, fp);
+	for (i = 0; i < sim->nstate_regions; i++)
+		fwrite(sim->state_regions[i].ptr, 1, sim->state_regions[i].size, fp);
+	off[0] = sim->rng.fptr - sim->rng.state;
+	off[1] = sim->rng.rptr - sim->rng.state;
+	fwrite(off, sizeof(off), 1, fp);
+	fwrite(sim->rng_state, 1, RNG_STATE_SIZE, fp);
+	fwrite(&nev, sizeof(int), 1, fp);
+	for (q = sim->evlist; q != NULL; q = q->next) {
+		memset(&sev, 0, sizeof(sev));
+		sev.evtime = q->evtime;
+		sev.evtype = q->evtype;
+		sev.eventity = q->eventity;
+		sev.haspkt = q->evtype == FROM_LAYER3;
+		if (sev.haspkt)
+			sev.pkt = *q->pktptr;
+		fwrite(&sev, sizeof(sev), 1, fp);
+	}
+	if (fclose(fp) != 0) {
+		perror(file);
+		return -1;
+	}
+	if (sim->TRACE>0)
+		printf("          SNAPSHOT: saved %d events at time %f to %s\n", nev, sim->time, file);
+	return 0;
+}
+
+int restore_snapshot(sim, file)
+	struct sim_state *sim;
+	char *file;
+{
+	int fd, i, nregions, nev;
+	struct stat st;
+	char *base, *p;
+	struct snapshot_event *sev;
+	struct event *evptr, *last;
+	long off[2];
+	size_t need;
+
+	if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(file);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		perror(file);
+		return -1;
+	}
+	p = base;
+
+	/* the file must hold everything the region table and event count say, */
+	/* checked before anything is copied over the running state            */
+	need = 8 + sizeof(int);
+	if ((size_t)st.st_size < need || memcmp(p, SNAPSHOT_MAGIC, 8) != 0)
+		goto bad;
+	p += 8;
+	memcpy(&nregions, p, sizeof(int));
+	p += sizeof(int);
+	if (nregions != sim->nstate_regions)
+		goto bad;
+	need += nregions * sizeof(size_t);
+	if ((size_t)st.st_size < need)
+		goto bad;
+	for (i = 0; i < nregions; i++, p += sizeof(size_t))
+		if (memcmp(p, &sim->state_regions[i].size, sizeof(size_t)) != 0)
+			goto bad;
+	for (i = 0; i < nregions; i++)
+		need += sim->state_regions[i].size;
+	need += sizeof(off) + RNG_STATE_SIZE + sizeof(int);
+	if ((size_t)st.st_size < need)
+		goto bad;
+	memcpy(&nev, base + need - sizeof(int), sizeof(int));
+	memcpy(off, base + need - sizeof(int) - RNG_STATE_SIZE - sizeof(off), sizeof(off));
+	if (nev < 0 || (size_t)st.st_size != need + (size_t)nev * sizeof(struct snapshot_event) ||
+			off[0] < 0 || off[0] >= RNG_STATE_SIZE / 4 || off[1] < 0 || off[1] >= RNG_STATE_SIZE / 4)
+		goto bad;
+	for (i = 0; i < nregions; i++) {
+		memcpy(sim->state_regions[i].ptr, p, sim->state_regions[i].size);
+		p += sim->state_regions[i].size;
+	}
+	memcpy(off, p, sizeof(off));
+	p += sizeof(off);
+	memcpy(sim->rng_state, p, RNG_STATE_SIZE);
+	p += RNG_STATE_SIZE;
+	sim->rng.fptr = sim->rng.state + off[0];
+	sim->rng.rptr = sim->rng.state + off[1];
+
+	/* replacing the event list of the fresh run with the saved one */
+	clear_events(sim);
+	p += sizeof(int);
+	sev = (struct snapshot_event *)p;
+	last = NULL;
+	for (i = 0; i < nev; i++) {
+		evptr = (struct event *)malloc(sizeof(struct event));
+		evptr->evtime = sev[i].evtime;
+		evptr->evtype = sev[i].evtype;
+		evptr->eventity = sev[i].eventity;
+		evptr->pktptr = NULL;
+		if (sev[i].haspkt) {
+			evptr->pktptr = (struct pkt *)malloc(sizeof(struct pkt));
+			*evptr->pktptr = sev[i].pkt;
+		}
+		/* saved in order, so appending keeps the list sorted */
+		evptr->next = NULL;
+		evptr->prev = last;
+		if (last == NULL)
+			sim->evlist = evptr;
+		else
+			last->next = evptr;
+		last = evptr;
+	}
+	munmap(base, st.st_size);
+	if (sim->TRACE>0)
+		printf("          SNAPSHOT: restored %d events at time %f from %s\n", nev, sim->time, file);
+	return 0;
+
+bad:
+	munmap(base, st.st_size);
+	fprintf(stderr, "%s is not a snapshot of this program and configuration\n", file);
+	return -1;
+}
+
+/* branches, Monte Carlo and the tuner fork and exit, so the library leaves them out */
+#ifndef RELIABLE_LIB
+/**************************** WHAT-IF BRANCHES ****************************/
+/* At --branch-at the run forks one child per --variant. Each child gets a */
+/* copy-on-write copy of the whole simulation, applies its parameters and  */
+/* calls the protocols' reload hooks, then runs to the end silently and    */
+/* sends its results back on a pipe. The parent goes on as the base run    */
+/* and prints all branches side by side after its own report.             */
+/***************************************************************************/
+
+/**
+ * function for parsing a --variant, a comma separated list of key=value
+ *
+ * @param spec Variant as given on the command line
+ * @param v Variant to fill in
+ * @return 0 on success, -1 on a malformed spec
+ */
+int parse_variant(spec, v)
+	char *spec;
+	struct variant *v;
+{
+	char buf[256], key[32], *tok, *save;
+	float val;
+
+	v->spec = spec;
+	v->win_size = -1;
+	v->timeout = v->lossprob = v->corruptprob = -1.0;
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if (sscanf(tok, "%31[^=]=%f", key, &val) != 2 || val < 0.0)
+			return -1;
+		if (strcmp(key, "window") == 0 && val >= 1.0 && val <= PROTO_RING)
+			v->win_size = (int)val;
+		else if (strcmp(key, "timeout") == 0 && val > 0.0)
+			v->timeout = val;
+		else if (strcmp(key, "loss") == 0 && val <= 1.0)
+			v->lossprob = val;
+		else if (strcmp(key, "corrupt") == 0 && val <= 1.0)
+			v->corruptprob = val;
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/* forks the variants; returns in the parent and in each child */
+void branch(sim)
+	struct sim_state *sim;
+{
+	int i, k, fds[2];
+	pid_t pid;
+	struct variant *v;
+
+	fflush(NULL);                 /* nothing buffered may be written twice */
+	for (i = 0; i < sim->nvariants; i++) {
+		v = &sim->variants[i];
+		if (pipe(fds) < 0 || (pid = fork()) < 0) {
+			perror("branch");
+			exit(-1);
+		}
+		if (pid > 0) {
+			close(fds[1]);
+			v->pid = pid;
+			v->fd = fds[0];
+			continue;
+		}
+
+		/* child: becomes branch i, quietly */
+		close(fds[0]);
+		for (k = 0; k < i; k++)
+			close(sim->variants[k].fd);
+		sim->branch_fd = fds[1];
+		sim->nvariants = 0;
+		sim->samples_fp = NULL;
+		sim->json_file = sim->csv_file = NULL;
+		sim->snapshot_file = NULL;
+		if ((k = open("/dev/null", O_WRONLY)) >= 0) {
+			dup2(k, 1);
+			close(k);
+		}
+		if (v->win_size > 0)
+			sim->win_size = v->win_size;
+		if (v->timeout > 0)
+			sim->timeout = v->timeout;
+		if (v->lossprob >= 0)
+			sim->lossprob = v->lossprob;
+		if (v->corruptprob >= 0)
+			sim->corruptprob = v->corruptprob;
+		for (k = 0; k < sim->nreload_hooks; k++)
+			sim->reload_hooks[k](sim);
+		return;
+	}
+	if (sim->TRACE>0)
+		printf("          BRANCH: forked %d variants at time %f\n", sim->nvariants, sim->time);
+}
+
+void write_branch_result(sim, fd)
+	struct sim_state *sim;
+	int fd;
+{
+	struct branch_result r;
+
+	r.time = sim->time;
+	r.goodput = measured_goodput(sim);
+	r.A_transport = sim->A_transport;
+	r.B_application = sim->B_application;
+	r.nretrans = sim->nretrans;
+	r.p50 = latency_at(measured_latency(sim), 50);
+	r.p99 = latency_at(measured_latency(sim), 99);
+	if (write(fd, &r, sizeof(r)) != sizeof(r))
+		exit(-1);
+	close(fd);
+}
+
+/* collects the results of the branches and prints them below the base run */
+void print_branches(sim)
+	struct sim_state *sim;
+{
+	int i, status;
+	struct branch_result r;
+	const char *fmt = " %-32s %10f %9d %9d %8d %10f %10f\n";
+
+	printf("\n");
+	printf(" %-32s %10s %9s %9s %8s %10s %10s\n", "What-if variant", "throughput",
+			"delivered", "sent", "retrans", "p50", "p99");
+	printf(fmt, "base", measured_goodput(sim), sim->B_application, sim->A_transport, sim->nretrans,
+			latency_at(measured_latency(sim), 50), latency_at(measured_latency(sim), 99));
+	for (i = 0; i < sim->nvariants; i++) {
+		if (read(sim->variants[i].fd, &r, sizeof(r)) == sizeof(r))
+			printf(fmt, sim->variants[i].spec, r.goodput, r.B_application,
+					r.A_transport, r.nretrans, r.p50, r.p99);
+		else
+			printf(" %-32s failed\n", sim->variants[i].spec);
+		close(sim->variants[i].fd);
+		waitpid(sim->variants[i].pid, &status, 0);
+	}
+}
+
+/******************************* MONTE CARLO *******************************/
+/* --seeds N runs the configuration for seeds s, s+1, ... in forked        */
+/* processes, --jobs at a time, each with its own copy of the simulator.   */
+/* Results are taken in seed order, so the output does not depend on the   */
+/* scheduling, and the experiment stops once the 95% CIs of throughput and */
+/* latency are narrower than --ci-width times their mean.                  */
+/***************************************************************************/
+
+/* two sided 95% quantiles of Student's t for 1..30 degrees of freedom */
+static const double t95[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+void mc_add(s, x)
+	struct mc_stat *s;
+	double x;
+{
+	double d = x - s->mean;
+	s->n++;
+	s->mean += d / s->n;
+	s->m2 += d * (x - s->mean);
+}
+
+double mc_stddev(s)
+	struct mc_stat *s;
+{
+	return s->n > 1 ? sqrt(s->m2 / (s->n - 1)) : 0.0;
+}
+
+/* half width of the 95% confidence interval of the mean */
+double mc_halfwidth(s)
+	struct mc_stat *s;
+{
+	if (s->n < 2)
+		return 0.0;
+	return (s->n <= 31 ? t95[s->n - 2] : 1.960) * mc_stddev(s) / sqrt(s->n);
+}
+
+int mc_narrow(sim, s)
+	struct sim_state *sim;
+	struct mc_stat *s;
+{
+	return 2 * mc_halfwidth(s) <= sim->ci_width * fabs(s->mean);
+}
+
+void mc_print(name, s)
+	const char *name;
+	struct mc_stat *s;
+{
+	printf(" %-12s mean %f stddev %f 95%% CI [%f, %f]\n", name, s->mean, mc_stddev(s),
+			s->mean - mc_halfwidth(s), s->mean + mc_halfwidth(s));
+}
+
+/**
+ * function for running the seeds of a Monte Carlo experiment
+ *
+ * @return 0 in the parent once the experiment is reported, 1 in a child,
+ *         which goes on to simulate its seed
+ */
+int monte_carlo(sim)
+	struct sim_state *sim;
+{
+	struct mc_stat thr, p50, p99;
+	struct branch_result r;
+	pid_t *pids;
+	int *fds;
+	int fd[2], next = 0, done = 0, nfailed = 0, stop = 0, i, k;
+
+	if (sim->njobs == 0 && (sim->njobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		sim->njobs = 1;
+	pids = (pid_t *)malloc(sim->nseeds * sizeof(pid_t));
+	fds = (int *)malloc(sim->nseeds * sizeof(int));
+	memset(&thr, 0, sizeof(thr));
+	memset(&p50, 0, sizeof(p50));
+	memset(&p99, 0, sizeof(p99));
+	fflush(NULL);
+	while (done < sim->nseeds && !stop) {
+		/* keeping njobs runs ahead of the one whose result is awaited */
+		for (; next < sim->nseeds && next < done + sim->njobs; next++) {
+			if (pipe(fd) < 0 || (pids[next] = fork()) < 0) {
+				perror("monte carlo");
+				exit(-1);
+			}
+			if (pids[next] > 0) {
+				close(fd[1]);
+				fds[next] = fd[0];
+				continue;
+			}
+			close(fd[0]);
+			for (k = done; k < next; k++)
+				close(fds[k]);
+			sim->branch_fd = fd[1];
+			sim->seed += next;
+			sim->samples_fp = NULL;
+			sim->json_file = sim->csv_file = NULL;
+			sim->snapshot_file = NULL;
+			if ((k = open("/dev/null", O_WRONLY)) >= 0) {
+				dup2(k, 1);
+				close(k);
+			}
+			return 1;
+		}
+		if (read(fds[done], &r, sizeof(r)) == sizeof(r)) {
+			mc_add(&thr, r.goodput);
+			mc_add(&p50, r.p50);
+			mc_add(&p99, r.p99);
+		}
+		else
+			nfailed++;
+		close(fds[done]);
+		waitpid(pids[done], NULL, 0);
+		done++;
+		stop = sim->ci_width > 0 && thr.n >= MC_MIN_RUNS &&
+			mc_narrow(sim, &thr) && mc_narrow(sim, &p50) && mc_narrow(sim, &p99);
+	}
+	/* runs started ahead are not needed any more */
+	for (i = done; i < next; i++) {
+		kill(pids[i], SIGTERM);
+		close(fds[i]);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+	free(fds);
+
+	printf(" Monte Carlo over %d seeds from %d", thr.n, sim->seed);
+	if (stop)
+		printf(", stopped at a relative 95%% CI width of %f", sim->ci_width);
+	printf("\n");
+	if (nfailed > 0)
+		printf(" %d runs failed\n", nfailed);
+	if (thr.n > 0) {
+		mc_print("throughput", &thr);
+		mc_print("p50 latency", &p50);
+		mc_print("p99 latency", &p99);
+	}
+	return 0;
+}
+
+/********************************* TUNER ***********************************/
+/* --tune N picks N configurations of window and timeout, log-uniformly    */
+/* from --tune-window and --tune-timeout, plus the one on the command line */
+/* and runs them by successive halving: every configuration runs on a     */
+/* fraction of -m messages, the better half by Pareto rank over goodput   */
+/* and p99 latency goes on to a rung of twice as many messages, and so on  */
+/* until TUNE_FINAL are left, which run on all -m. Runs are forked --jobs  */
+/* at a time with the same seed, so configurations see the same channel,  */
+/* and a run taking over TUNE_EVENTS_PER_MSG events a message is given up. */
+/* The report is the last rung, with its Pareto frontier marked.          */
+/***************************************************************************/
+
+/* whether a is at least as good as b on both goodput and p99, and better on one */
+int tune_dominates(a, b)
+	struct tune_cand *a;
+	struct tune_cand *b;
+{
+	float ga = a->r.goodput, gb = b->r.goodput;
+	return ga >= gb && a->r.p99 <= b->r.p99 && (ga > gb || a->r.p99 < b->r.p99);
+}
+
+/* non-dominated sorting: rank 0 is the frontier, rank 1 the frontier without it, ... */
+void tune_rank(c, n)
+	struct tune_cand *c;
+	int n;
+{
+	int i, j, left = 0, rank;
+
+	for (i = 0; i < n; i++) {
+		c[i].rank = c[i].ok ? -1 : n;    /* runs that failed come last */
+		left += c[i].ok;
+	}
+	for (rank = 0; left > 0; rank++) {
+		for (i = 0; i < n; i++) {
+			if (c[i].rank != -1)
+				continue;
+			for (j = 0; j < n; j++)
+				if (j != i && (c[j].rank == -1 || c[j].rank == rank) && tune_dominates(&c[j], &c[i]))
+					break;
+			if (j == n)
+				c[i].rank = rank;
+		}
+		for (i = 0; i < n; i++)
+			left -= c[i].rank == rank;
+	}
+}
+
+/* better rank first, then higher goodput */
+int tune_cmp(pa, pb)
+	const void *pa;
+	const void *pb;
+{
+	const struct tune_cand *a = pa, *b = pb;
+	float ga, gb;
+	if (a->rank != b->rank)
+		return a->rank - b->rank;
+	if (!a->ok)
+		return 0;
+	ga = a->r.goodput;
+	gb = b->r.goodput;
+	return (ga < gb) - (ga > gb);
+}
+
+/**
+ * function for running one rung of the tuner
+ *
+ * @param c Configurations to run, their results are filled in
+ * @param n Number of configurations
+ * @param msgs Messages each run simulates
+ * @return 0 in the parent once all results are in, 1 in a child,
+ *         which goes on to simulate its configuration
+ */
+int tune_rung(sim, c, n, msgs)
+	struct sim_state *sim;
+	struct tune_cand *c;
+	int n;
+	int msgs;
+{
+	pid_t *pids = (pid_t *)malloc(n * sizeof(pid_t));
+	int *fds = (int *)malloc(n * sizeof(int));
+	int fd[2], next = 0, done = 0, k;
+
+	fflush(NULL);
+	while (done < n) {
+		for (; next < n && next < done + sim->njobs; next++) {
+			if (pipe(fd) < 0 || (pids[next] = fork()) < 0) {
+				perror("tune");
+				exit(-1);
+			}
+			if (pids[next] > 0) {
+				close(fd[1]);
+				fds[next] = fd[0];
+				continue;
+			}
+			close(fd[0]);
+			for (k = done; k < next; k++)
+				close(fds[k]);
+			sim->branch_fd = fd[1];
+			sim->win_size = c[next].win_size;
+			sim->timeout = c[next].timeout;
+			sim->nsimmax = msgs;
+			sim->max_events = (long)msgs * TUNE_EVENTS_PER_MSG;
+			sim->samples_fp = NULL;
+			sim->json_file = sim->csv_file = NULL;
+			sim->snapshot_file = NULL;
+			if ((k = open("/dev/null", O_WRONLY)) >= 0) {
+				dup2(k, 1);
+				close(k);
+			}
+			return 1;
+		}
+		c[done].ok = read(fds[done], &c[done].r, sizeof(c[done].r)) == sizeof(c[done].r) &&
+			c[done].r.time > 0;
+		close(fds[done]);
+		waitpid(pids[done], NULL, 0);
+		done++;
+	}
+	free(pids);
+	free(fds);
+	return 0;
+}
+
+/**
+ * function for tuning window and timeout to the channel by successive halving
+ *
+ * @return 0 in the parent once the frontier is reported, 1 in a child,
+ *         which goes on to simulate its configuration
+ */
+int tune(sim)
+	struct sim_state *sim;
+{
+	struct tune_cand *c;
+	float lw, lt;
+	int n = sim->ntune + 1, rungs = 0, rung, msgs, i, k;
+
+	if (sim->njobs == 0 && (sim->njobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		sim->njobs = 1;
+	c = (struct tune_cand *)malloc(n * sizeof(struct tune_cand));
+	memset(c, 0, n * sizeof(struct tune_cand));
+
+	/* the configuration on the command line, then ntune log-uniform ones */
+	c[0].win_size = sim->win_size;
+	c[0].timeout = sim->timeout;
+	sim_srand(sim, sim->seed);
+	lw = log(sim->tune_win[1] + 1.0) - log(sim->tune_win[0]);
+	lt = log(sim->tune_timeout[1]) - log(sim->tune_timeout[0]);
+	for (i = 1; i < n; i++) {
+		c[i].win_size = (int)(sim->tune_win[0] * exp(lw * jimsrand(sim)));
+		if (c[i].win_size > sim->tune_win[1])
+			c[i].win_size = sim->tune_win[1];
+		c[i].timeout = sim->tune_timeout[0] * exp(lt * jimsrand(sim));
+	}
+
+	for (k = n; k > TUNE_FINAL; k = (k + 1) / 2)
+		rungs++;
+	printf(" Tuning window %d..%d and timeout %f..%f from %d configurations in %d rungs\n",
+			sim->tune_win[0], sim->tune_win[1], sim->tune_timeout[0], sim->tune_timeout[1], n, rungs + 1);
+	for (rung = 0; ; rung++) {
+		msgs = sim->nsimmax >> (rungs - rung);
+		if (msgs < TUNE_MIN_MSGS)
+			msgs = sim->nsimmax < TUNE_MIN_MSGS ? sim->nsimmax : TUNE_MIN_MSGS;
+		if (tune_rung(sim, c, n, msgs) == 1)
+			return 1;
+		tune_rank(c, n);
+		qsort(c, n, sizeof(struct tune_cand), tune_cmp);
+		for (i = k = 0; i < n; i++)
+			k += !c[i].ok;
+		printf(" Rung %d: %d configurations on %d messages", rung + 1, n, msgs);
+		if (k > 0)
+			printf(", %d given up", k);
+		printf("\n");
+		if (rung == rungs)
+			break;
+		n = (n + 1) / 2;
+	}
+
+	printf("\n");
+	printf(" %-8s %10s %10s %10s %8s %10s  %s\n", "window", "timeout", "throughput", "goodput",
+			"retrans", "p99", "Pareto frontier of the last rung (*)");
+	for (i = 0; i < n; i++) {
+		if (!c[i].ok) {
+			printf(" %-8d %10f given up\n", c[i].win_size, c[i].timeout);
+			continue;
+		}
+		printf(" %-8d ", c[i].win_size);
+		if (c[i].timeout > 0)
+			printf("%10f", c[i].timeout);
+		else
+			printf("%10s", "default");
+		printf(" %10f %10f %8d %10f  %s\n", c[i].r.A_transport / c[i].r.time,
+				c[i].r.goodput, c[i].r.nretrans, c[i].r.p99,
+				c[i].rank == 0 ? "*" : "");
+	}
+	free(c);
+	return 0;
+}
+
+#endif
+
 /********************* EVENT HANDLINE ROUTINES *******/
 /*  The next set of routines handle the event list   */
 /*****************************************************/
 
-void generate_next_arrival()
+void generate_next_arrival(sim)
+	struct sim_state *sim;
 {
 	double x,log(),ceil();
 	struct event *evptr;
@@ -327,34 +1783,50 @@ void generate_next_arrival()
 	float ttime;
 	int tempint;
 
-	if (TRACE>2)
+	if (sim->TRACE>2)
 		printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
 
-	x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
+	x = sim->lambda*jimsrand(sim)*2;  /* x is uniform on [0,2*lambda] */
 	/* having mean of lambda        */
 	evptr = (struct event *)malloc(sizeof(struct event));
-	evptr->evtime =  time + x;
+	evptr->evtime =  sim->sim_ticks + TICKS(x);
 	evptr->evtype =  FROM_LAYER5;
-	if (BIDIRECTIONAL && (jimsrand()>0.5) )
+	if (BIDIRECTIONAL && (jimsrand(sim)>0.5) )
 		evptr->eventity = B;
 	else
 		evptr->eventity = A;
-	insertevent(evptr);
+	insertevent(sim, evptr);
 }
 
+/* packets one message takes in A's send buffer */
+int sndbuf_need(sim)
+	struct sim_state *sim;
+{
+	return sim->msg_size > 0 ? seg_count(sim, sim->msg_size) : 1;
+}
 
-void insertevent(p)
+/* hands A a packet's worth of data, noting the time for the sender queueing delay */
+void give_A(sim, message)
+	struct sim_state *sim;
+	struct msg message;
+{
+	SNDQ(sim->sndq_in++) = sim->time;
+	sim->protocol->A_output(sim, message);
+}
+
+void insertevent(sim, p)
+	struct sim_state *sim;
 	struct event *p;
 {
 	struct event *q,*qold;
 
-	if (TRACE>2) {
-		printf("            INSERTEVENT: time is %lf\n",time);
-		printf("            INSERTEVENT: future time will be %lf\n",p->evtime);
+	if (sim->TRACE>2) {
+		printf("            INSERTEVENT: time is %lf\n",sim->time);
+		printf("            INSERTEVENT: future time will be %lf\n",TICKS_TIME(p->evtime));
 	}
-	q = evlist;     /* q points to header of list in which p struct inserted */
+	q = sim->evlist;     /* q points to header of list in which p struct inserted */
 	if (q==NULL) {   /* list is empty */
-		evlist=p;
+		sim->evlist=p;
 		p->next=NULL;
 		p->prev=NULL;
 	}
@@ -366,11 +1838,11 @@ void insertevent(p)
 			p->prev = qold;
 			p->next = NULL;
 		}
-		else if (q==evlist) { /* front of list */
-			p->next=evlist;
+		else if (q==sim->evlist) { /* front of list */
+			p->next=sim->evlist;
 			p->prev=NULL;
 			p->next->prev=p;
-			evlist = p;
+			sim->evlist = p;
 		}
 		else {     /* middle of list */
 			p->next=q;
@@ -381,13 +1853,36 @@ void insertevent(p)
 	}
 }
 
-void printevlist()
+/* empties the event list, packets and all, and frees the event a */
+/* sim_exit() that returned left sim_run() handling                */
+void clear_events(sim)
+	struct sim_state *sim;
+{
+	struct event *q;
+
+	if (sim->cur_event != NULL) {
+		if (sim->cur_event->evtype == FROM_LAYER3)
+			free(sim->cur_event->pktptr);
+		free(sim->cur_event);
+		sim->cur_event = NULL;
+	}
+	while (sim->evlist != NULL) {
+		q = sim->evlist;
+		sim->evlist = sim->evlist->next;
+		if (q->evtype == FROM_LAYER3)
+			free(q->pktptr);
+		free(q);
+	}
+}
+
+void printevlist(sim)
+	struct sim_state *sim;
 {
 	struct event *q;
 	int i;
 	printf("--------------\nEvent List Follows:\n");
-	for(q = evlist; q!=NULL; q=q->next) {
-		printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
+	for(q = sim->evlist; q!=NULL; q=q->next) {
+		printf("Event time: %f, type: %d entity: %d\n",TICKS_TIME(q->evtime),q->evtype,q->eventity);
 	}
 	printf("--------------\n");
 }
@@ -397,24 +1892,25 @@ void printevlist()
 /********************** Student-callable ROUTINES ***********************/
 
 /* called by students routine to cancel a previously-started timer */
-void stoptimer(AorB)
+void stoptimer(sim, AorB)
+	struct sim_state *sim;
 	int AorB;  /* A or B is trying to stop timer */
 {
 	struct event *q,*qold;
 
-	if (TRACE>2)
-		printf("          STOP TIMER: stopping timer at %f\n",time);
+	if (sim->TRACE>2)
+		printf("          STOP TIMER: stopping timer at %f\n",sim->time);
 	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-	for (q=evlist; q!=NULL ; q = q->next)
+	for (q=sim->evlist; q!=NULL ; q = q->next)
 		if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) {
 			/* remove this event */
 			if (q->next==NULL && q->prev==NULL)
-				evlist=NULL;         /* remove first and only event on list */
+				sim->evlist=NULL;         /* remove first and only event on list */
 			else if (q->next==NULL) /* end of list - there is one in front */
 				q->prev->next = NULL;
-			else if (q==evlist) { /* front of list - there must be event after */
+			else if (q==sim->evlist) { /* front of list - there must be event after */
 				q->next->prev=NULL;
-				evlist = q->next;
+				sim->evlist = q->next;
 			}
 			else {     /* middle of list */
 				q->next->prev = q->prev;
@@ -423,11 +1919,13 @@ void stoptimer(AorB)
 			free(q);
 			return;
 		}
-	printf("Warning: unable to cancel your timer. It wasn't running.\n");
+	if (sim->TRACE >= 0)
+		printf("Warning: unable to cancel your timer. It wasn't running.\n");
 }
 
 
-void starttimer(AorB,increment)
+void starttimer(sim, AorB,increment)
+	struct sim_state *sim;
 	int AorB;  /* A or B is trying to stop timer */
 	float increment;
 {
@@ -436,45 +1934,106 @@ void starttimer(AorB,increment)
 	struct event *evptr;
 	//char *malloc();
 
-	if (TRACE>2)
-		printf("          START TIMER: starting timer at %f\n",time);
+	if (sim->TRACE>2)
+		printf("          START TIMER: starting timer at %f\n",sim->time);
 	/* be nice: check to see if timer is already started, if so, then  warn */
 	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-	for (q=evlist; q!=NULL ; q = q->next)
+	for (q=sim->evlist; q!=NULL ; q = q->next)
 		if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) {
-			printf("Warning: attempt to start a timer that is already started\n");
+			if (sim->TRACE >= 0)
+				printf("Warning: attempt to start a timer that is already started\n");
 			return;
 		}
 
 	/* create future event for when timer goes off */
 	evptr = (struct event *)malloc(sizeof(struct event));
-	evptr->evtime =  time + increment;
+	evptr->evtime =  sim->sim_ticks + TICKS(increment);
 	evptr->evtype =  TIMER_INTERRUPT;
 	evptr->eventity = AorB;
-	insertevent(evptr);
+	insertevent(sim, evptr);
+}
+
+
+/********************* BOTTLENECK LINK ***********************/
+/* The link out of each entity serializes one packet every   */
+/* 1/bandwidth time units and holds the backlog in a finite  */
+/* FIFO or RED queue. Packets that do not fit are dropped.   */
+/*************************************************************/
+
+/* returns the arrival time at the other side, or -1 if the queue drops the packet */
+double link_schedule(sim, AorB)
+	struct sim_state *sim;
+	int AorB;  /* entity putting the packet on its outgoing link */
+{
+	double txtime, start;
+	float minth, maxth, p;
+	int depth;
+
+	txtime = 1.0 / sim->bandwidth;
+	start = sim->link_busy[AorB] > sim->time ? sim->link_busy[AorB] : sim->time;
+
+	/* packets still waiting for, or in, serialization */
+	depth = (int)ceil((start - sim->time) / txtime - 0.001);
+
+	if (sim->qdisc == QDISC_RED) {
+		sim->red_avg[AorB] = (1 - RED_WEIGHT) * sim->red_avg[AorB] + RED_WEIGHT * depth;
+		minth = sim->qlimit / 4.0;
+		maxth = 3 * sim->qlimit / 4.0;
+		if (sim->red_avg[AorB] >= maxth)
+			p = 1.0;
+		else if (sim->red_avg[AorB] > minth)
+			p = RED_MAXP * (sim->red_avg[AorB] - minth) / (maxth - minth);
+		else
+			p = 0.0;
+		if (p > 0.0 && jimsrand(sim) < p)
+			depth = sim->qlimit;     /* early drop */
+	}
+
+	if (depth >= sim->qlimit) {
+		sim->nqdrop++;
+		if (sim->TRACE>0)
+			printf("          TOLAYER3: packet dropped at bottleneck queue\n");
+		return -1;
+	}
+	if (depth + 1 > sim->maxqdepth)
+		sim->maxqdepth = depth + 1;
+
+	sim->link_busy[AorB] = start + txtime;
+	return sim->link_busy[AorB] + sim->propdelay;
 }
 
 
 /************************** TOLAYER3 ***************/
-void tolayer3(AorB,packet)
+void tolayer3(sim, AorB,packet)
+	struct sim_state *sim;
 	int AorB;  /* A or B is trying to stop timer */
 	struct pkt packet;
 {
 	struct pkt *mypktptr;
 	struct event *evptr,*q;
 	//char *malloc();
-	float lastime, x, jimsrand();
+	int64_t lastime;
+	double arrival;
+	float x;
 	int i;
 
 
-	ntolayer3++;
+	sim->ntolayer3++;
+
+	if(AorB == 0) sim->A_transport += 1;
+
+	/* queue at the bottleneck before the packet reaches the media */
+	if (sim->bandwidth > 0.0 && (arrival = link_schedule(sim, AorB)) < 0)
+		return;
 
-	if(AorB == 0) A_transport += 1;
+	sim->raw_bytes += sizeof(struct pkt);
+	if (sim->wire)
+		wire_roundtrip(sim, AorB, &packet);
 
 	/* simulate losses: */
-	if (jimsrand() < lossprob)  {
-		nlost++;
-		if (TRACE>0)
+	if (jimsrand(sim) < sim->lossprob)  {
+		sim->nlost++;
+		if (sim->TRACE>0)
 			printf("          TOLAYER3: packet being lost\n");
 		return;
 	}
@@ -485,12 +2044,12 @@ void tolayer3(AorB,packet)
 	mypktptr->seqnum = packet.seqnum;
 	mypktptr->acknum = packet.acknum;
 	mypktptr->checksum = packet.checksum;
-	for (i=0; i<20; i++)
+	for (i=0; i<PAYLOAD_LEN; i++)
 		mypktptr->payload[i] = packet.payload[i];
-	if (TRACE>2)  {
+	if (sim->TRACE>2)  {
 		printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
 				mypktptr->acknum,  mypktptr->checksum);
-		for (i=0; i<20; i++)
+		for (i=0; i<(AorB == B ? 0 : PAYLOAD_LEN); i++)   /* ACKs carry no payload */
 			printf("%c",mypktptr->payload[i]);
 		printf("\n");
 	}
@@ -504,81 +2063,370 @@ void tolayer3(AorB,packet)
 	   medium can not reorder, so make sure packet arrives between 1 and 10
 	   time units after the latest arrival time of packets
 	   currently in the medium on their way to the destination */
-	lastime = time;
-	/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-	for (q=evlist; q!=NULL ; q = q->next)
-		if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) )
-			lastime = q->evtime;
-	evptr->evtime =  lastime + 1 + 9*jimsrand();
+	if (sim->bandwidth > 0.0) {
+		/* the FIFO link already keeps packets in order */
+		evptr->evtime = TICKS(arrival);
+	}
+	else {
+		lastime = sim->sim_ticks;
+		/* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
+		for (q=sim->evlist; q!=NULL ; q = q->next)
+			if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) )
+				lastime = q->evtime;
+		evptr->evtime =  lastime + TICKS(1 + 9*jimsrand(sim));
+	}
 
 
 
 	/* simulate corruption: */
-	if (jimsrand() < corruptprob)  {
-		ncorrupt++;
-		if ( (x = jimsrand()) < .75)
+	if (jimsrand(sim) < sim->corruptprob)  {
+		sim->ncorrupt++;
+		if ( (x = jimsrand(sim)) < .75)
 			mypktptr->payload[0]='Z';   /* corrupt payload */
 		else if (x < .875)
 			mypktptr->seqnum = 999999;
 		else
 			mypktptr->acknum = 999999;
-		if (TRACE>0)
+		if (sim->TRACE>0)
 			printf("          TOLAYER3: packet being corrupted\n");
 	}
 
-	if (TRACE>2)
+	if (sim->TRACE>2)
 		printf("          TOLAYER3: scheduling arrival on other side\n");
-	insertevent(evptr);
+	sim->inchannel[evptr->eventity]++;
+	insertevent(sim, evptr);
 }
 
-void tolayer5(AorB,datasent)
+/* sends the packet through the compact wire format, as a byte backend would */
+void wire_roundtrip(sim, AorB,packet)
+	struct sim_state *sim;
 	int AorB;
-	char datasent[20];
+	struct pkt *packet;
 {
-	int i;
-	if (TRACE>2) {
+	uint8_t buf[WIRE_MAXLEN];
+	int len, i, empty = 1;
+
+	/* B's packets are ACKs with no payload, except for NAKs */
+	for (i = 0; i < PAYLOAD_LEN; i++)
+		if (packet->payload[i] != 0)
+			empty = 0;
+	len = wire_encode(&sim->wire_tx[AorB], packet, AorB == B && empty ? WIRE_ACK : 0, buf);
+	sim->wire_bytes += len;
+	if (wire_decode(&sim->wire_rx[AorB], buf, len, packet) != len) {
+		if (sim->TRACE >= 0)
+			printf("PANIC: Undecodable packet on the wire!");
+		sim_exit(sim, 57);
+	}
+}
+
+void tolayer5(sim, AorB,datasent)
+	struct sim_state *sim;
+	int AorB;
+	char datasent[PAYLOAD_LEN];
+{
+	int i, len = PAYLOAD_LEN;
+	const char *data = datasent;
+	if (sim->TRACE>2) {
 		printf("          TOLAYER5: data received: ");
-		for (i=0; i<20; i++)
+		for (i=0; i<PAYLOAD_LEN; i++)
 			printf("%c",datasent[i]);
 		printf("\n");
 	}
 
+	/* the packet takes a slot of B's receive buffer until the application reads it */
+	if (sim->rcvbuf > 0 && AorB == B) {
+		rcv_drain(sim);
+		if (sim->rcv_queued == sim->rcvbuf) {
+			if (sim->TRACE >= 0)
+				printf("PANIC: Delivered into a full receive buffer!");
+			sim_exit(sim, 58);
+		}
+		if (++sim->rcv_queued > sim->rcv_maxqueued)
+			sim->rcv_maxqueued = sim->rcv_queued;
+	}
+
+	/* segmented messages are checked once their last segment is in */
+	if (sim->msg_size > 0) {
+		if(AorB == 1) sim->B_application += 1;
+		if ((data = seg_input(sim, datasent, &len)) == NULL)
+			return;
+	}
+
 	/* Check for non-existent packet */
-	if (application_msgs[cur_msg_recv].msg_chars[0] == '\0') {
-		printf("PANIC: Unexpected/Non-existent packet!");
-		exit(52);
+	if (sim->cur_msg_recv >= sim->cur_msg_sent) {
+		if (sim->TRACE >= 0)
+			printf("PANIC: Unexpected/Non-existent packet!");
+		sim_exit(sim, 52);
 	}
 
 
 	/* Check for duplicate packets */
-	if (strncmp(application_msgs[cur_msg_recv].msg_chars, datasent, 20) != 0){
-		printf("Expected: ");
-		for(int i=0; i<20; i+=1)
-			printf("%c", application_msgs[cur_msg_recv].msg_chars[i]);
-		printf("\nGot: ");
-		for(int i=0; i<20; i+=1)
-			printf("%c", datasent[i]);
-		exit(63);
+	if (!check_msg(sim, sim->cur_msg_recv, data, len)){
+		if (sim->TRACE >= 0) {
+			printf("Expected: ");
+			for(int i=0; i<(sim->msg_size > 0 ? sim->msg_size : PAYLOAD_LEN); i+=1)
+				printf("%c", TRACKED(sim->cur_msg_recv).letter);
+			printf("\nGot: ");
+			for(int i=0; i<len; i+=1)
+				printf("%c", data[i]);
+		}
+		sim_exit(sim, 63);
 	}
 
 	/* Check for out-of-order packets */
-	if (cur_msg_recv != 0){
-		if (application_msgs[cur_msg_recv-1].delivered != 1)
-			exit(145);
+	if (sim->cur_msg_recv != 0){
+		if (TRACKED(sim->cur_msg_recv-1).delivered != 1)
+			sim_exit(sim, 145);
+	}
+
+	TRACKED(sim->cur_msg_recv).delivered = 1; // Mark delivered
+	hdr_record(&sim->latency, (uint64_t)((sim->time - TRACKED(sim->cur_msg_recv).sent_time) * LAT_SCALE));
+	hdr_record(&sim->sample_latency, (uint64_t)((sim->time - TRACKED(sim->cur_msg_recv).sent_time) * LAT_SCALE));
+	if (sim->warmup > 0.0 && TRACKED(sim->cur_msg_recv).sent_time >= sim->warmup)
+		hdr_record(&sim->ss_latency, (uint64_t)((sim->time - TRACKED(sim->cur_msg_recv).sent_time) * LAT_SCALE));
+	sim->cur_msg_recv += 1;
+	sim->bytes_delivered += len;
+
+	if(AorB == 1 && sim->msg_size == 0) sim->B_application += 1;
+}
+
+/* whether data is message n as the main loop generated it */
+int check_msg(sim, n, data, len)
+	struct sim_state *sim;
+	int n;
+	const char *data;
+	int len;
+{
+	int i;
+	if (len != (sim->msg_size > 0 ? sim->msg_size : PAYLOAD_LEN))
+		return 0;
+	for (i = 0; i < len; i++)
+		if (data[i] != TRACKED(n).letter)
+			return 0;
+	return 1;
+}
+
+/* B's application reads one packet every 1/drain_rate time units while any are queued */
+void rcv_drain(sim)
+	struct sim_state *sim;
+{
+	int n;
+	if (sim->rcv_queued == 0) {
+		sim->rcv_read = sim->time;
+		return;
+	}
+	n = (int)((sim->time - sim->rcv_read) * sim->drain_rate);
+	if (n >= sim->rcv_queued) {
+		sim->rcv_queued = 0;
+		sim->rcv_read = sim->time;
+	}
+	else {
+		sim->rcv_queued -= n;
+		sim->rcv_read += n / sim->drain_rate;
+	}
+}
+
+int getwinsize(sim)
+	struct sim_state *sim;
+{
+	return sim->win_size;
+}
+
+int getccmode(sim)
+	struct sim_state *sim;
+{
+	return sim->cc_algo;
+}
+
+/* instrumentation: called by the protocols so the simulator can report window use */
+void report_window(sim, AorB, inflight)
+	struct sim_state *sim;
+	int AorB;
+	int inflight;
+{
+	sim->winocc[AorB] = inflight;
+}
+
+void report_retransmit(sim, AorB)
+	struct sim_state *sim;
+	int AorB;
+{
+	if (AorB == A)
+		sim->nretrans++;
+}
+
+void report_probe(sim, AorB)
+	struct sim_state *sim;
+	int AorB;
+{
+	if (AorB == A)
+		sim->nprobes++;
+}
+
+void report_nak(sim, AorB)
+	struct sim_state *sim;
+	int AorB;
+{
+	if (AorB == B)
+		sim->nnaks++;
+}
+
+/* called when a buffered packet leaves A for the first time, in the order A got them */
+void report_send(sim, AorB)
+	struct sim_state *sim;
+	int AorB;
+{
+	if (AorB == A && sim->sndq_out < sim->sndq_in) {
+		hdr_record(&sim->sndq_latency, (uint64_t)((sim->time - SNDQ(sim->sndq_out)) * LAT_SCALE));
+		sim->sndq_out++;
+	}
+}
+
+/* called whenever the number of packets buffered at A changes; resumes a waiting layer 5 */
+void report_backlog(sim, AorB, queued)
+	struct sim_state *sim;
+	int AorB;
+	int queued;
+{
+	struct event *evptr;
+
+	if (AorB != A)
+		return;
+	sim->backlog = queued;
+	if (!sim->l5_blocked || sim->backlog + sndbuf_need(sim) > sim->sndbuf)
+		return;
+	sim->l5_blocked = 0;
+	sim->l5_blocked_time += sim->time - sim->l5_blocked_at;
+	/* the held back message arrives now, and the arrival process goes on from it */
+	evptr = (struct event *)malloc(sizeof(struct event));
+	evptr->evtime = sim->sim_ticks;
+	evptr->evtype = FROM_LAYER5;
+	evptr->eventity = A;
+	insertevent(sim, evptr);
+}
+
+/* ends the run with code: exits, or returns to the caller of sim_run() that set sim->bail */
+void sim_exit(sim, code)
+	struct sim_state *sim;
+	int code;
+{
+	if (sim->bail != NULL) {
+		sim->exit_code = code;
+		longjmp(*sim->bail, 1);
 	}
+#ifdef RELIABLE_LIB
+	abort();                     /* reliable_run() always sets sim->bail */
+#else
+	exit(code);
+#endif
+}
 
-	application_msgs[cur_msg_recv].delivered = 1; // Mark delivered
-	cur_msg_recv += 1;
+/* registers a piece of protocol state to be carried by snapshots */
+void register_state(sim, ptr, size)
+	struct sim_state *sim;
+	void *ptr;
+	size_t size;
+{
+	int i;
+	for (i = 0; i < sim->nstate_regions; i++)
+		if (sim->state_regions[i].ptr == ptr)
+			return;
+	if (sim->nstate_regions == MAX_STATE_REGIONS) {
+		if (sim->TRACE >= 0)
+			printf("PANIC: too many state regions registered!");
+		sim_exit(sim, 54);
+	}
+	sim->state_regions[sim->nstate_regions].ptr = ptr;
+	sim->state_regions[sim->nstate_regions].size = size;
+	sim->nstate_regions++;
+}
 
-	if(AorB == 1) B_application += 1;
+/* registers a function re-reading the parameters after a what-if branch */
+void register_reload(sim, fn)
+	struct sim_state *sim;
+	void (*fn)(struct sim_state *sim);
+{
+	int i;
+	for (i = 0; i < sim->nreload_hooks; i++)
+		if (sim->reload_hooks[i] == fn)
+			return;
+	if (sim->nreload_hooks == MAX_RELOAD_HOOKS) {
+		if (sim->TRACE >= 0)
+			printf("PANIC: too many reload hooks registered!");
+		sim_exit(sim, 55);
+	}
+	sim->reload_hooks[sim->nreload_hooks++] = fn;
+}
+
+float gettimeout(sim)
+	struct sim_state *sim;
+{
+	return sim->timeout;
+}
+
+/* capacity of B's receive buffer in packets, 0 if the application reads at once */
+int getrcvbuf(sim)
+	struct sim_state *sim;
+{
+	return sim->rcvbuf;
+}
+
+/* free slots in B's receive buffer now */
+int getrcvfree(sim)
+	struct sim_state *sim;
+{
+	rcv_drain(sim);
+	return sim->rcvbuf - sim->rcv_queued;
+}
+
+float getpacerate(sim)
+	struct sim_state *sim;
+{
+	return sim->pace_rate;
+}
+
+int getfeck(sim)
+	struct sim_state *sim;
+{
+	return sim->fec_block;
+}
+
+int getfecm(sim)
+	struct sim_state *sim;
+{
+	return sim->fec_parity;
+}
+
+int getharq(sim)
+	struct sim_state *sim;
+{
+	return sim->harq;
+}
+
+int getnak(sim)
+	struct sim_state *sim;
+{
+	return sim->use_nak;
+}
+
+double get_sim_time(sim)
+	struct sim_state *sim;
+{
+	return sim->time;
 }
 
-int getwinsize()
+/* the simulator clock itself, exact however long the run */
+int64_t get_sim_ticks(sim)
+	struct sim_state *sim;
 {
-	return win_size;
+	return sim->sim_ticks;
 }
 
-float get_sim_time()
+/* moves the clock to ticks */
+void set_time(sim, ticks)
+	struct sim_state *sim;
+	int64_t ticks;
 {
-	return time;
+	sim->sim_ticks = ticks;
+	sim->time = TICKS_TIME(ticks);
 }
@@ -0,0 +1,107 @@
+#include "../include/simulator.h"
+#include "../include/sim.h"
+#include "../include/timers.h"
+
+/* ******************************************************************
+   Logical timers for entity A.
+
+   The simulator gives each entity a single timer. The routines below
+   keep a deadline per logical timer and always arm the simulator
+   timer for the earliest one. When it goes off, A_timerinterrupt()
+   calls lt_interrupt() and then lt_expire() until it returns -1,
+   handling each expired timer id it gets back.
+ **********************************************************************/
+
+#define A 0
+#define TRUE 1
+#define FALSE 0
+#define TIMER_EPS 0.01
+
+/* points the simulator timer at the earliest logical deadline */
+void lt_rearm(struct sim_state *sim)
+{
+	struct lt_state *lt = &sim->lt;
+	int i, earliest = -1;
+	double curr_time = get_sim_time(sim);
+
+	for (i = 0; i < NTIMERS; i++){
+		if (lt->active[i] && (earliest < 0 || lt->deadline[i] < lt->deadline[earliest])){
+			earliest = i;
+		}
+	}
+	if (lt->armed_on && (earliest < 0 || lt->armed != lt->deadline[earliest])){
+		stoptimer(sim, A);
+		lt->armed_on = FALSE;
+	}
+	if (earliest >= 0 && !lt->armed_on){
+		lt->armed = lt->deadline[earliest];
+		starttimer(sim, A, lt->armed > curr_time ? lt->armed - curr_time : 0);
+		lt->armed_on = TRUE;
+	}
+}
+
+void lt_init(struct sim_state *sim)
+{
+	struct lt_state *lt = &sim->lt;
+	int i;
+	for (i = 0; i < NTIMERS; i++){
+		lt->active[i] = FALSE;
+	}
+	lt->armed_on = FALSE;
+	SAVE_STATE(sim, lt->deadline);
+	SAVE_STATE(sim, lt->active);
+	SAVE_STATE(sim, lt->armed);
+	SAVE_STATE(sim, lt->armed_on);
+}
+
+/* (re)starts logical timer id to go off increment time units from now */
+void lt_start(struct sim_state *sim, int id, float increment)
+{
+	struct lt_state *lt = &sim->lt;
+
+	lt->deadline[id] = get_sim_time(sim) + increment;
+	lt->active[id] = TRUE;
+	lt_rearm(sim);
+}
+
+void lt_stop(struct sim_state *sim, int id)
+{
+	struct lt_state *lt = &sim->lt;
+
+	if (!lt->active[id]){
+		return;
+	}
+	lt->active[id] = FALSE;
+	lt_rearm(sim);
+}
+
+int lt_running(struct sim_state *sim, int id)
+{
+	return sim->lt.active[id];
+}
+
+/* called first thing in A_timerinterrupt(): the simulator timer is no longer running */
+void lt_interrupt(struct sim_state *sim)
+{
+	sim->lt.armed_on = FALSE;
+}
+
+/**
+ * function for taking the next expired logical timer
+ *
+ * @return id of a timer that went off (now stopped), -1 once none is left
+ */
+int lt_expire(struct sim_state *sim)
+{
+	struct lt_state *lt = &sim->lt;
+	int i;
+	double curr_time = get_sim_time(sim);
+	for (i = 0; i < NTIMERS; i++){
+		if (lt->active[i] && lt->deadline[i] - curr_time < TIMER_EPS){
+			lt->active[i] = FALSE;
+			return i;
+		}
+	}
+	lt_rearm(sim);
+	return -1;
+}
@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "../include/proto.h"
+#include "../include/wire.h"
+
+/* ******************************************************************
+   Compact wire format.
+
+   struct pkt is three ints and the payload, whatever it carries. On
+   the wire the sequence and ACK numbers of a stream change little from
+   one packet to the next (A's ACK number and B's sequence number never
+   do), so each is sent as the zigzag-coded difference from the previous
+   packet, in LEB128 varints of 7 bits per byte. The checksum travels as
+   its low 16 bits, which is all of it under CHECKSUM=inet, and the
+   receiver recomputes the rest. ACKs send no payload at all.
+ **********************************************************************/
+
+void wire_init(struct wire_ctx *ctx)
+{
+	ctx->seqnum = 0;
+	ctx->acknum = 0;
+}
+
+static int put_varint(uint8_t *buf, uint32_t value)
+{
+	int n = 0;
+	while (value >= 0x80){
+		buf[n++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buf[n++] = (uint8_t)value;
+	return n;
+}
+
+/* returns the bytes read, 0 if the varint runs past len, or -1 if it is over 5 bytes */
+static int get_varint(const uint8_t *buf, int len, uint32_t *value)
+{
+	int n;
+	*value = 0;
+	for (n = 0; n < len && n < 5; n++){
+		*value |= (uint32_t)(buf[n] & 0x7f) << (7 * n);
+		if ((buf[n] & 0x80) == 0){
+			return n + 1;
+		}
+	}
+	return n == 5 ? -1 : 0;
+}
+
+static uint32_t zigzag(int value, int prev)
+{
+	uint32_t delta = (uint32_t)value - (uint32_t)prev;
+	return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static int unzigzag(uint32_t code, int prev)
+{
+	return (int)((uint32_t)prev + ((code >> 1) ^ -(code & 1)));
+}
+
+/**
+ * function for serializing a packet
+ *
+ * @param ctx Encoder state of the stream
+ * @param packet Packet to send
+ * @param flags WIRE_ACK to leave the payload out
+ * @param buf Output, at least WIRE_MAXLEN bytes
+ * @return The number of bytes written
+ */
+int wire_encode(struct wire_ctx *ctx, const struct pkt *packet, int flags, uint8_t *buf)
+{
+	int n = 0;
+	buf[n++] = (uint8_t)flags;
+	n += put_varint(buf + n, zigzag(packet->seqnum, ctx->seqnum));
+	n += put_varint(buf + n, zigzag(packet->acknum, ctx->acknum));
+	buf[n++] = (uint8_t)packet->checksum;
+	buf[n++] = (uint8_t)(packet->checksum >> 8);
+	if (!(flags & WIRE_ACK)){
+		memcpy(buf + n, packet->payload, PAYLOAD_LEN);
+		n += PAYLOAD_LEN;
+	}
+	ctx->seqnum = packet->seqnum;
+	ctx->acknum = packet->acknum;
+	return n;
+}
+
+/**
+ * function for parsing the next packet of a stream. A checksum that does
+ * not match the packet decodes as one that validate_checksum() rejects.
+ *
+ * @param ctx Decoder state of the stream
+ * @param buf Input
+ * @param len Bytes available in buf
+ * @param packet Output
+ * @return The number of bytes read, 0 if the packet is not all in buf yet,
+ *         or -1 if buf does not hold a packet
+ */
+int wire_decode(struct wire_ctx *ctx, const uint8_t *buf, int len, struct pkt *packet)
+{
+	uint32_t seqcode, ackcode;
+	int n = 1, r, flags, checksum;
+
+	if (len < 1){
+		return 0;
+	}
+	if ((flags = buf[0]) & ~WIRE_ACK){
+		return -1;
+	}
+	if ((r = get_varint(buf + n, len - n, &seqcode)) <= 0){
+		return r;
+	}
+	n += r;
+	if ((r = get_varint(buf + n, len - n, &ackcode)) <= 0){
+		return r;
+	}
+	n += r;
+	if (len - n < 2 + ((flags & WIRE_ACK) ? 0 : PAYLOAD_LEN)){
+		return 0;
+	}
+	checksum = buf[n] | (buf[n + 1] << 8);
+	n += 2;
+	if (flags & WIRE_ACK){
+		memset(packet->payload, 0, PAYLOAD_LEN);
+	}
+	else {
+		memcpy(packet->payload, buf + n, PAYLOAD_LEN);
+		n += PAYLOAD_LEN;
+	}
+	packet->seqnum = ctx->seqnum = unzigzag(seqcode, ctx->seqnum);
+	packet->acknum = ctx->acknum = unzigzag(ackcode, ctx->acknum);
+	packet->checksum = compute_checksum(packet->seqnum, packet->acknum, packet->payload);
+	if ((packet->checksum & 0xffff) != checksum){
+		packet->checksum ^= 0x10000;
+	}
+	return n;
+}